@@ -0,0 +1,85 @@
+#ifndef ELL_CURVE_H
+#define ELL_CURVE_H
+
+/*! \file */
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Binary motor current curve store.
+ *
+ * File layout: one ell_curve_header followed by fixed size ell_curve_record
+ * entries, appended in capture order. All fields are native endian and
+ * naturally aligned so the file can be mapped and used in place.
+ */
+static constexpr size_t ELL_CURVE_POINTS = 87;    //(period, current) pairs per C1/C2 reply
+
+struct ell_curve_header {
+    char magic[8];              //"ELLCURVE"
+    uint32_t version;           //format version, currently 1
+    uint32_t record_size;       //sizeof(ell_curve_record)
+    uint32_t points;            //ELL_CURVE_POINTS
+    uint32_t reserved[3];
+};
+
+struct ell_curve_record {
+    int64_t timestamp_ns;               //host time of capture, ns since unix epoch
+    uint64_t serial;                    //device serial number
+    uint8_t address;                    //address of device on controller
+    uint8_t motor;                      //motor number, 1 or 2
+    uint8_t reserved[6];
+    uint16_t current[ELL_CURVE_POINTS]; //current per point
+    uint8_t period[ELL_CURVE_POINTS];   //period per point
+    uint8_t pad[3];
+};
+
+static_assert(sizeof(ell_curve_header) == 32, "ell_curve_header layout changed");
+static_assert(sizeof(ell_curve_record) == 288, "ell_curve_record layout changed");
+
+/*
+ * Decodes the payload of a C1/C2 reply (everything after "<addr>C<n>") into
+ * period and current arrays of ELL_CURVE_POINTS entries each.
+ * Returns false if the payload is too short or contains non-digits.
+ */
+bool ell_curve_decode(std::string_view payload, uint8_t *period, uint16_t *current);
+
+/*
+ * Appends records to a curve file, writing the header if the file is new.
+ */
+class ell_curve_writer {
+public:
+    explicit ell_curve_writer(const std::string &path);
+    void append(const ell_curve_record &rec);
+    void append(const std::vector<ell_curve_record> &recs);
+
+private:
+    std::string _path;
+};
+
+/*
+ * Read-only memory mapped view of a curve file.
+ */
+class ell_curve_file {
+public:
+    explicit ell_curve_file(const std::string &path);
+    ~ell_curve_file();
+    ell_curve_file(const ell_curve_file &) = delete;
+    ell_curve_file &operator=(const ell_curve_file &) = delete;
+
+    size_t size() const;
+    std::span<const ell_curve_record> records() const;
+    std::vector<const ell_curve_record*> select(uint64_t serial, uint8_t motor) const;
+
+private:
+    void *_map = nullptr;
+    size_t _maplen = 0;
+    const ell_curve_record *_records = nullptr;
+    size_t _count = 0;
+};
+
+#endif // ELL_CURVE_H
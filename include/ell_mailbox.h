@@ -0,0 +1,56 @@
+#ifndef ELL_MAILBOX_H
+#define ELL_MAILBOX_H
+
+/*! \file */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+/*
+ * Single producer, single consumer queue of reply frames for one device
+ * address. The reader thread pushes, the thread holding the bus pops;
+ * neither ever blocks the other.
+ */
+class ell_mailbox {
+public:
+    static constexpr size_t CAPACITY = 16;
+
+    /**
+     * \return false if the mailbox is full and the frame was not queued
+     */
+    bool push(std::string &&frame) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        _slots[tail % CAPACITY] = std::move(frame);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \return false if the mailbox is empty
+     */
+    bool pop(std::string &frame) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        frame = std::move(_slots[head % CAPACITY]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<std::string, CAPACITY> _slots;
+    std::atomic<size_t> _head{0};       //next slot to pop, consumer owned
+    std::atomic<size_t> _tail{0};       //next slot to push, producer owned
+};
+
+#endif // ELL_MAILBOX_H
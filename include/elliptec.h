@@ -4,18 +4,31 @@
 /*! \file */
 
 //#include "defines.h"
-#include "boost_serial.h"
+#include "ell_transport.h"
+#include "ell_curve.h"
+#include "ell_expected.h"
+#include "ell_mailbox.h"
+#include "ell_units.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 struct ell_device {
@@ -29,6 +42,17 @@ struct ell_device {
     uint64_t pulses;        //pulses per unit
 };
 
+struct ell_motor_info {
+    uint8_t motor = 0;          //motor number
+    bool loop_on = false;
+    bool motor_on = false;
+    uint16_t current = 0;       //1866 per A
+    uint16_t ramp_up = 0;       //PWM increase / ms
+    uint16_t ramp_down = 0;     //PWM decrease / ms
+    uint16_t period_fwd = 0;    //14.74 MHz / forward frequency
+    uint16_t period_bwd = 0;    //14.74 MHz / backward frequency
+};
+
 struct ell_response {
     uint8_t address = 0;
     std::string type = "";
@@ -71,10 +95,186 @@ const std::vector<std::string> error_msgs = {
     //14-255 Reserved
 };
 
+enum ell_alert_kind {
+    ALERT_CURRENT_RISE = 0,     //motor current above baseline
+    ALERT_DEVICE_ERROR = 1,     //repeated THERMAL_ERROR / OVER_CURRENT
+    ALERT_FREQ_DRIFT = 2        //motor period moved away from baseline
+};
+
+struct ell_alert {
+    std::string address;        //address of device on controller
+    ell_alert_kind kind;
+    uint8_t motor = 0;          //motor number, 0 if not motor specific
+    double value = 0;           //current value, or error count
+    double baseline = 0;
+    std::string message;
+    std::chrono::system_clock::time_point time;
+};
+
+struct ell_monitor_config {
+    double bus_fraction = 0.02;                         //share of bus time the monitor may use
+    std::chrono::milliseconds motion_holdoff{1000};     //quiet time after a motion command
+    bool sample_curves = false;                         //also read C1/C2 ...
+    uint16_t curve_every = 10;                          //... every this many rounds per device
+    std::string curve_path = "";                        //append sampled curves to this file
+    uint16_t baseline_samples = 5;                      //samples averaged into baselines
+    double current_rise = 0.2;                          //relative rise over baseline
+    double freq_drift = 0.02;                           //relative period change over baseline
+    uint16_t error_repeat = 3;                          //THERMAL_ERROR / OVER_CURRENT count ...
+    uint16_t error_window = 10;                         //... within this many status samples
+};
+
+enum ell_maint_op {
+    MAINT_OPTIMIZE = 0,     //om
+    MAINT_CLEAN = 1,        //cm
+    MAINT_SEARCH_FREQ = 2,  //s1, s2, then us
+    MAINT_SCAN_CURRENT = 3  //c1, c2
+};
+
+struct ell_maint_result {
+    std::string address;                    //address of device on controller
+    ell_maint_op op;                        //operation that was run
+    uint8_t status = 0;                     //last status code reported, see ell_errors
+    bool completed = false;                 //all steps finished without error
+    bool cancelled = false;                 //stopped by stop_clean
+    std::chrono::milliseconds duration{0};  //time from start to last reply
+};
+
+enum ell_job_state {
+    JOB_WAITING = 0,        //waiting for an idle window
+    JOB_RUNNING = 1,
+    JOB_INTERRUPTED = 2,    //stopped by a motion command, resumes in next idle window
+    JOB_DONE = 3,
+    JOB_FAILED = 4
+};
+
+struct ell_job_info {
+    uint32_t id = 0;
+    std::string address;            //address of device on controller
+    ell_maint_op op;
+    ell_job_state state = JOB_WAITING;
+    std::chrono::seconds idle{0};   //bus and device idle time required to run
+    uint16_t interruptions = 0;
+    uint8_t status = 0;             //last status code reported, see ell_errors
+};
+
+struct ell_frame_event {
+    std::string frame;              //reply without terminator
+    std::string address;            //address the frame came from
+    bool solicited = false;         //answered a command that was waiting for it
+    std::chrono::steady_clock::time_point received;
+};
+
+enum ell_motion_event_kind {
+    MOTION_STARTED = 0,     //command written to the bus
+    MOTION_BUSY = 1,        //device reported BUSY while moving
+    MOTION_REACHED = 2,     //final position or OK status received
+    MOTION_ERROR = 3        //device reported an error instead of a position
+};
+
+struct ell_motion_event {
+    std::string address;            //address of device on controller
+    ell_motion_event_kind kind;
+    std::string command;            //motion command the event belongs to
+    double position = NAN;          //deg or mm when reached, NAN if not reported
+    uint8_t code = 0;               //status code for BUSY and ERROR, see ell_errors
+    std::string message;            //err2string(code)
+    std::chrono::steady_clock::time_point time;
+};
+
+struct ell_sweep_step {
+    size_t index = 0;                                   //position in the frequency list
+    double freq_hz = 0;                                 //requested frequency
+    double actual_hz = 0;                               //frequency of the encoded period
+    std::chrono::steady_clock::time_point sent;         //e1 frame written
+    std::chrono::microseconds lag{0};                   //sent behind schedule
+    uint8_t status = 0;                                 //reply status, see ell_errors
+};
+
+struct ell_scan_point {
+    size_t index = 0;
+    double target = 0;          //deg or mm
+    double position = 0;        //reported by the device, deg or mm
+    bool corrected = false;     //jog drifted and an absolute move was needed
+};
+
+struct ell_multi_move_result {
+    std::chrono::milliseconds predicted{0};     //common arrival, from the first command written
+    std::chrono::milliseconds actual{0};        //until the last axis reported its position
+    std::vector<uint8_t> velocity;              //percent used per axis, in target order
+    std::vector<double> position;               //reached per axis, deg or mm, NaN without a position reply
+    std::vector<bool> reached;                  //position within DEGERR/MMERR of the target; not retried
+};
+
+struct ell_paddle_opt_config {
+    std::array<double, 3> start = {0, 0, 0};   //deg, paddles move here first
+    uint16_t coarse_ms = 100;                   //paddle_drivetime per coarse step, 0 skips the sweep
+    uint16_t coarse_steps = 10;                 //coarse steps swept per paddle
+    double step = 8;                            //initial fine step in deg, halved when nothing improves
+    double min_step = 0.66;                     //fine search ends below this step
+    uint32_t max_iterations = 500;              //metric evaluations
+};
+
+struct ell_paddle_opt_result {
+    std::array<double, 3> position = {0, 0, 0};    //best paddle positions in deg
+    double metric = 0;                              //metric at position
+    uint32_t iterations = 0;                        //metric evaluations
+    std::chrono::milliseconds duration{0};
+    double iterations_per_s = 0;
+};
+
+struct ell_device_config {
+    uint64_t serial = 0;        //identifies the device when it was readdressed
+    std::string address;        //address of device on controller
+    bool stage = false;         //linear or rotary, only stages have the settings below
+    uint8_t velocity = 0;       //percent
+    int64_t jog = 0;            //jog step size in steps
+    int64_t home_offset = 0;    //steps
+    std::array<std::array<uint16_t, 2>, 2> period = {};    //motor 1 and 2 fwd and bwd, 14.74 MHz / frequency
+};
+
+struct ell_config {
+    std::vector<ell_device_config> devices;
+};
+
+struct ell_restore_result {
+    std::vector<std::string> saved;     //addresses that changed and got us
+    std::vector<uint64_t> missing;      //serials of the snapshot not on the bus
+    size_t writes = 0;                  //setting frames written, us included
+};
+
+// one line per device: serial address [velocity jog offset f1 b1 f2 b2]
+std::string ell_config_to_string(const ell_config &cfg);
+ell_config ell_config_from_string(const std::string &text);
+
+enum ell_home_policy {
+    HOME_ALWAYS = 0,        //home every device on startup
+    HOME_IF_NEEDED = 1,     //home only devices whose position cannot be trusted
+    HOME_LAZY = 2,          //as HOME_IF_NEEDED, but home on the first motion command
+    HOME_NEVER = 3
+};
+
+// "always", "if-needed", "lazy" or "never"
+ell_home_policy home_policy_from_string(const std::string &name);
+
+enum ell_device_kind {
+    KIND_ROTARY = 0,    //ELL8, ELL14, ELL18, positions in deg
+    KIND_LINEAR = 1,    //ELL7, ELL10, ELL17, ELL20, positions in mm
+    KIND_PADDLE = 2,    //MPC320 polarization controller
+    KIND_PIEZO = 3      //ELL5 piezo motor
+};
+
+template <ell_device_kind K> class ell_handle;
+using RotaryStage = ell_handle<KIND_ROTARY>;
+using LinearStage = ell_handle<KIND_LINEAR>;
+using Paddle = ell_handle<KIND_PADDLE>;
+using Piezo = ell_handle<KIND_PIEZO>;
+
 class elliptec {
 
 public:
     elliptec(const std::string devname, const std::vector<uint8_t> inmids, const bool dohome = true, const bool freqsearch = true);
+    elliptec(const std::string devname, const std::vector<uint8_t> inmids, const ell_home_policy home_policy, const bool freqsearch = true, const std::string state_path = "", const ell_transport_config transport = {});
     ~elliptec();
 
     //serial
@@ -82,16 +282,24 @@ public:
     void close();
     bool isopen();
 
+    //no console output for every reply and lookup
+    void set_quiet(bool quiet);
+    bool quiet();
+
+    //holds the bus for a batch of commands from this thread, owns no lock
+    //if another thread has the bus
+    std::unique_lock<std::recursive_mutex> try_claim_bus();
+
     //low level
     void get_info(std::string addr);
-    void get_status(std::string addr);
+    uint8_t get_status(std::string addr);
     void save_userdata(std::string addr);
     void change_address(std::string addr, std::string newaddr);
-    void get_motor_info(std::string addr, uint8_t motor_num);
+    ell_motor_info get_motor_info(std::string addr, uint8_t motor_num);
     void set_motor_freq(std::string addr, std::string dir, uint8_t motor_num, uint16_t freq, bool factory_reset=false);
     void scan_motor_current_curve(std::string addr, uint8_t motor_num);
     void search_freq(std::string addr);
-    std::vector<std::pair<uint8_t, uint8_t>> get_motor_current_curve(std::string addr, uint8_t motor_num);
+    std::vector<std::pair<uint8_t, uint16_t>> get_motor_current_curve(std::string addr, uint8_t motor_num);
     void isolate_device(std::string addr, uint8_t minutes);
     void home(std::string addr, std::string dir = "0");
     void paddle_home(std::string addr, uint8_t paddle_num);
@@ -104,7 +312,8 @@ public:
     void move_fwd(std::string addr);
     void move_bwd(std::string addr);
     void stop(std::string addr);
-    void get_position(std::string addr);
+    void stop_now(std::string addr);     //does not wait for a command holding the bus
+    double get_position(std::string addr);
     uint8_t get_velocity(std::string addr);
     void set_velocity(std::string addr, uint8_t percent);
     void groupaddress(std::string addr, std::string groupaddr);
@@ -116,7 +325,77 @@ public:
     void stop_clean(std::string addr);
     void energize_motor(std::string addr, double freq);
     void halt_motor(std::string addr);
+
+    //moves several axes at once, targets are address and deg or mm. With
+    //equal_arrival, axes with less travel are slowed down to finish together.
+    ell_multi_move_result move_together(const std::vector<std::pair<std::string, double>> &targets, bool equal_arrival = true);
+
+    //uniform scan with jog moves, on_point returning false ends the scan early
+    size_t jog_scan(std::string addr, double start, double step, size_t count, std::function<bool(const ell_scan_point&)> on_point = nullptr);
+
+    //piezo sweep, on_step returning false ends the sweep early
+    size_t piezo_sweep(std::string addr, const std::vector<double> &freqs_hz, std::chrono::microseconds dwell, std::function<bool(const ell_sweep_step&)> on_step = nullptr);
+    size_t piezo_sweep(std::string addr, double start_hz, double stop_hz, double step_hz, std::chrono::microseconds dwell, std::function<bool(const ell_sweep_step&)> on_step = nullptr);
+
+    //paddle optimiser, maximises metric
+    ell_paddle_opt_result optimize_paddles(std::string addr, std::function<double()> metric, ell_paddle_opt_config cfg = {});
+
+    //exception free variants for batch use, errors are returned instead
+    ell_expected<uint8_t> try_get_status(std::string addr);
+    ell_expected<double> try_get_position(std::string addr);
+    std::vector<ell_expected<double>> try_get_positions(const std::vector<std::string> &addrs);
+    ell_expected<double> try_move_absolute(std::string addr, double pos);
+    ell_expected<double> try_move_relative(std::string addr, double pos);
+    ell_expected<double> try_home(std::string addr, std::string dir = "0");
+    ell_expected<uint8_t> try_get_velocity(std::string addr);
+    ell_expected<void> try_set_velocity(std::string addr, uint8_t percent);
+    //every connected device within a few frame times, results by address
+    std::unordered_map<std::string, ell_expected<double>> try_stop_all();
+    std::unordered_map<std::string, ell_expected<uint8_t>> try_status_all();
+
+    //typed handle, checks once that the device at addr is of kind K
+    template <ell_device_kind K>
+    ell_handle<K> handle(std::string addr);
+
+    //unit conversion for one device, made once from its pulses
+    DegreeConverter degree_converter(std::string addr);
+    MillimeterConverter millimeter_converter(std::string addr);
+
+    //discovery
+    std::vector<ell_device> scan_bus();
+
+    //maintenance
+    std::vector<ell_maint_result> run_maintenance(ell_maint_op op, std::vector<std::string> addrs = {}, std::function<bool()> cancel = nullptr);
+    uint32_t add_background_job(std::string addr, ell_maint_op op, std::chrono::seconds idle = std::chrono::seconds(60));
+    void remove_background_job(uint32_t id);
+    std::vector<ell_job_info> background_jobs();
+    size_t capture_current_curves(std::string path, std::vector<std::string> addrs = {}, bool scan = false);
+
+    //health monitor
+    void start_health_monitor(ell_monitor_config cfg, std::function<void(const ell_alert&)> on_alert);
+    void stop_health_monitor();
+
+    //reader thread
+    void start_reader(std::function<void(const ell_frame_event&)> on_frame = nullptr);
+    void stop_reader();
+    bool reader_running();
+    std::vector<ell_frame_event> frame_events();
+
+    //motion events
+    uint32_t subscribe_motion(std::function<void(const ell_motion_event&)> on_event);
+    void unsubscribe_motion(uint32_t id);
+    std::vector<ell_motion_event> motion_events();
     
+    void save_state();
+
+    //velocity, jog step, home offset, info and motor info are served from a
+    //cache kept current by the setters; refresh re-reads them ("" for all)
+    void refresh_settings(std::string addr = "");
+
+    //settings of all devices; restore writes only the settings that differ
+    ell_config snapshot_config();
+    ell_restore_result restore_config(const ell_config &cfg);
+
     void print_addr_info(std::string addr);
     void cr();
     void lf();
@@ -129,6 +408,26 @@ private:
     std::vector<uint8_t> _inmids;
     std::string _devname;
     double _current_pos;
+    ell_home_policy _home_policy;
+    std::string _state_path;                                //persisted positions, "" for none
+    std::unordered_map<std::string, int64_t> _positions;    //last reported position in steps
+    std::vector<std::string> _needs_home;                   //lazily homed on first motion
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> _settings;  //settings replies by address and query
+
+    // settings cache
+    std::string cached_query(const std::string &addr, const std::string &query, const std::string &reply);
+    void cache_setting(const std::string &addr, const std::string &query, const std::string &reply);
+    std::optional<uint8_t> cached_velocity(const std::string &addr);
+    void forget_settings(const std::string &addr, const std::string &query = "");
+    void forget_written(const std::string &frame, const std::string &reply_from);
+    void power_cycled(const std::string &addr);
+
+    std::unordered_map<uint64_t, int64_t> load_state();
+    bool readdress(std::string addr, std::string newaddr);
+    ell_device_config read_config(const ell_device &dev);
+    std::vector<uint64_t> restore_addresses(const ell_config &cfg, ell_restore_result &result);
+    bool position_trusted(std::string addr, const std::unordered_map<uint64_t, int64_t> &saved);
+    void ensure_homed(std::string addr);
 
     
     // Direction constants
@@ -139,12 +438,47 @@ private:
     static constexpr double DEGERR = 0.1;
     static constexpr double MMERR = 0.05;
 
+    // Maintenance polling
+    static constexpr uint16_t MAINT_POLL_MS = 250;     //gs interval per device
+    static constexpr uint16_t MAINT_READ_MS = 50;      //read timeout while polling
+    static constexpr uint16_t MAINT_DRAIN_MS = 1000;   //wait for late completion reply
+
+    // Paddles
+    static constexpr double PADDLE_DEG_PER_STEP = 0.33;
+    static constexpr double PADDLE_RANGE_DEG = 170;
+
+    // Multi-axis moves
+    static constexpr uint8_t VELOCITY_MIN_PERCENT = 50;    //slower settings risk stalling
+    static constexpr uint16_t MULTI_POLL_MS = 50;          //gs interval for an axis that has not reported
+    double full_speed(std::string addr);                    //nominal deg/s or mm/s at 100 %
+
+    // Piezo
+    static constexpr double PIEZO_CLOCK_HZ = 14740000;
+    static constexpr uint16_t SWEEP_SPIN_US = 500;     //busy wait before each sweep step
+
+    // Bus discovery
+    static constexpr size_t SCAN_PROBE_CHARS = 3;      //"Ain"
+    static constexpr size_t SCAN_REPLY_CHARS = 35;     //"AIN" + 30 data + "\r\n"
+    static constexpr uint16_t SCAN_MARGIN_MS = 20;     //device turnaround plus USB adapter latency
+
+    // Bus-wide commands
+    static constexpr size_t BROADCAST_GAP_CHARS = 2;   //idle line between two replies
+    static constexpr size_t STOP_FRAME_CHARS = 3;      //"Ams"
+    static constexpr size_t STOP_REPLY_CHARS = 13;     //"APO" + 8 hex digits + "\r\n", as for gp
+    static constexpr size_t STATUS_REPLY_CHARS = 7;    //"AGS" + 2 hex digits + "\r\n"
+    static constexpr uint16_t STOP_POLL_MS = 20;       //gs interval while stages come to rest
+    static constexpr uint16_t STOP_SETTLE_MS = 2000;   //longest wait for them before gp
+
     // serial
     std::string query(const std::string &data);
-    std::unique_ptr<Boost_serial> bserial;
+    std::unique_ptr<ell_transport> bserial;
     std::string read();
-    void write(const std::string &data);
+    std::string read(std::chrono::steady_clock::time_point deadline);
+    size_t read_frames(std::vector<std::string_view> &frames);
+    void write(const std::string &data, const std::string &reply_from = "");
+    std::mutex _writemtx;           //write_frame() may come from stop_now() without the bus
     uint16_t _ser_timeout;
+    static constexpr double CHAR_TIME = 10.0/9600;  //seconds per 8N1 character at 9600 baud
 
     std::unordered_map<std::string, std::vector<uint8_t>> devtype;
 
@@ -160,6 +494,113 @@ private:
     
 
     void search_motor_freq(std::string addr, uint8_t motor_num);
+    ell_motor_info parse_motor_info(const std::string &response);
+    ell_device parse_devinfo(const std::string &response);
+    bool read_motor_current_curve(std::string addr, uint8_t motor_num, ell_curve_record &rec);
+    std::vector<std::string> maint_steps(std::string addr, ell_maint_op op);
+
+    // bus ownership and idle tracking, all guarded by _busmtx
+    std::recursive_mutex _busmtx;
+    std::string _expect_addr;       //address the next read is waiting for
+    bool _background_io = false;    //bus traffic from job or monitor thread, not counted as activity
+    std::atomic<bool> _quiet{false};    //no per-reply console output, also read by quiet()
+    std::chrono::steady_clock::time_point _last_activity;
+    std::chrono::steady_clock::time_point _last_motion;     //end of last motion command
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> _addr_activity;
+
+    // background jobs, guarded by _jobmtx
+    struct ell_job {
+        ell_job_info info;
+        std::vector<std::string> steps;
+        size_t step = 0;
+        std::chrono::steady_clock::time_point last_poll;
+        std::chrono::steady_clock::time_point quiet_until; //late replies still expected
+    };
+    std::vector<ell_job> _jobs;
+    uint32_t _next_job_id = 1;
+    bool _jobs_stop = false;
+    std::mutex _jobmtx;
+    std::condition_variable _jobcv;
+    std::thread _jobthread;
+
+    void job_loop();
+    void job_step(uint32_t id);
+    void job_status(ell_job &job, uint8_t code);
+    void preempt_jobs(std::string addr);
+    bool route_stray(std::string_view response);
+    bool route_job_status(std::string_view response);
+
+    // ms written by stop_now() while another thread held the bus
+    std::mutex _stopmtx;
+    std::vector<std::string> _stop_pending;     //reply not yet seen
+    std::vector<std::string> _stop_requests;    //until the next motion of the device
+    bool route_stop_reply(std::string_view response);
+    bool stop_requested(const std::string &addr);
+
+    // held for the duration of a motion command: preempts background jobs
+    // on the device, homes it first if needs_home and homing was deferred,
+    // and records the end of motion for the health monitor
+    class motion_scope {
+    public:
+        motion_scope(elliptec &ell, const std::string &addr, bool needs_home = false);
+        ~motion_scope();
+    private:
+        elliptec &_ell;
+    };
+
+    // suppresses per-reply console output while held
+    class quiet_scope {
+    public:
+        explicit quiet_scope(elliptec &ell) : _ell(ell), _was(ell._quiet) { _ell._quiet = true; }
+        ~quiet_scope() { _ell._quiet = _was; }
+    private:
+        elliptec &_ell;
+        bool _was;
+    };
+
+    // health monitor
+    bool _monitor_stop = false;
+    std::mutex _monmtx;
+    std::condition_variable _moncv;
+    std::thread _monthread;
+    void monitor_loop(ell_monitor_config cfg, std::function<void(const ell_alert&)> on_alert);
+
+    // reader thread. Replies to an address that has a command waiting go to
+    // its mailbox, everything else is unsolicited and only an event.
+    static constexpr size_t READER_EVENTS = 1024;   //frame_events() backlog
+    std::atomic<bool> _reader_running{false};
+    std::atomic<bool> _reader_stop{false};
+    std::array<ell_mailbox, 16> _mailboxes;
+    std::array<std::atomic<bool>, 16> _awaiting{};  //a command to the address waits for its reply
+    std::vector<std::string> _mail_batch;           //backs the views of read_frames()
+    std::mutex _mailmtx;
+    std::condition_variable _mailcv;
+    std::deque<ell_frame_event> _events;            //guarded by _mailmtx
+    std::thread _readerthread;
+    void reader_loop(std::function<void(const ell_frame_event&)> on_frame);
+    std::string read_mailbox(std::chrono::steady_clock::time_point deadline);
+    size_t read_mailboxes(std::vector<std::string_view> &frames);
+    void expect_reply_from(std::string addr);
+
+    // motion events, guarded by _motionmtx
+    static constexpr size_t MOTION_EVENTS = 1024;   //motion_events() backlog
+    std::mutex _motionmtx;
+    std::deque<ell_motion_event> _motion_events;
+    std::unordered_map<uint32_t, std::function<void(const ell_motion_event&)>> _motion_subs;
+    uint32_t _next_motion_sub = 1;
+    std::string _motion_cmd;                        //last motion command, guarded by _busmtx
+    void emit_motion(ell_motion_event ev);
+    void motion_write(const std::string &msg);
+    ell_response motion_response();
+    ell_expected<ell_device> try_device(const std::string &addr);
+    ell_expected<ell_response> try_exchange(const std::string &addr, const std::string &msg, bool motion, bool needs_home = false);
+    ell_expected<double> try_position_reply(const std::string &addr, const ell_expected<ell_response> &ret);
+    std::unordered_map<std::string, ell_expected<ell_response>> try_broadcast(const std::vector<std::string> &addrs, const std::string &cmd, size_t reply_chars);
+    ell_expected<double> try_move_to(const std::string &addr, const std::string &cmd, int64_t target);
+    template <ell_device_kind K> friend class ell_handle;
+    std::string handle_command(const std::string &addr, const std::string &frame, const std::string &reply, bool motion = false, bool needs_home = false);
+    std::string piezo_frame(const std::string &addr, double freq_hz);
+    double paddle_probe(const std::string &msg, const std::function<double()> &metric, double *value);
     
     bool devintype(std::string type, uint8_t id);
     bool devislinrot(std::string addr);
@@ -180,4 +621,116 @@ private:
     std::string int2addr(uint8_t id);
 };
 
+/*
+ * Device handle for one kind of device, obtained once through
+ * elliptec::handle<K>(). The kind is checked when the handle is made and
+ * its unit conversion is kept in the handle, so calls skip the device
+ * lookups and type checks of the address based methods. Methods that do
+ * not apply to K do not compile.
+ */
+template <ell_device_kind K>
+class ell_handle {
+public:
+    using unit_type = std::conditional_t<K == KIND_LINEAR, Millimeters, Degrees>;
+
+    const std::string &address() const { return _addr; }
+    const ell_converter<unit_type> &converter() const requires (K == KIND_ROTARY || K == KIND_LINEAR) { return _conv; }
+
+    // deg for rotary stages, mm for linear stages; return the position reported
+    double move_absolute(double pos) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return move_absolute(unit_type(pos)).value;
+    }
+    double move_relative(double dist) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return move_relative(unit_type(dist)).value;
+    }
+    unit_type move_absolute(unit_type pos) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return _conv.to_units(move_absolute(_conv.to_steps(pos)));
+    }
+    unit_type move_relative(unit_type dist) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return _conv.to_units(move_relative(_conv.to_steps(dist)));
+    }
+    Steps move_absolute(Steps pos) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return motion("ma" + _ell.step2hex(pos.value), true);
+    }
+    Steps move_relative(Steps dist) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return motion("mr" + _ell.step2hex(dist.value), true);
+    }
+    double home(std::string dir = "0") requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        std::lock_guard<std::recursive_mutex> lock(_ell._busmtx);
+        std::erase(_ell._needs_home, _addr);
+        return to_units(motion("ho" + dir, false));
+    }
+    double jog_fwd() requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return to_units(motion("fw", true));
+    }
+    double jog_bwd() requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return to_units(motion("bw", true));
+    }
+    double stop() requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return to_units(motion("ms", false));
+    }
+    double position() requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return to_units(Steps(_ell.hex2step(_ell.handle_command(_addr, _addr + "gp", "PO"))));
+    }
+    void set_velocity(uint8_t percent) requires (K == KIND_ROTARY || K == KIND_LINEAR) {
+        _ell.set_velocity(_addr, percent);
+    }
+
+    // paddle 1...3, deg; return the position reported
+    double move_absolute(uint8_t paddle, double deg) requires (K == KIND_PADDLE) {
+        return paddle_motion(paddle, "a", _ell.step2hex(std::lround(deg/elliptec::PADDLE_DEG_PER_STEP), 4));
+    }
+    double move_relative(uint8_t paddle, double deg) requires (K == KIND_PADDLE) {
+        //16 bit two's complement, step2hex would give 8 digits for a negative distance
+        return paddle_motion(paddle, "r", _ell.step2hex(std::lround(deg/elliptec::PADDLE_DEG_PER_STEP) & 0xFFFF, 4));
+    }
+    double drive_time(uint8_t paddle, uint16_t ms, bool forward = true) requires (K == KIND_PADDLE) {
+        return paddle_motion(paddle, "t", _ell.us2hex((ms & 0x7FFF) | (forward ? 0x8000 : 0)));
+    }
+
+    void energize(double freq_hz) requires (K == KIND_PIEZO) {
+        _ell.handle_command(_addr, _ell.piezo_frame(_addr, freq_hz), "GS", true);
+    }
+    void halt() requires (K == KIND_PIEZO) {
+        _ell.handle_command(_addr, _addr + "h1", "GS");
+    }
+
+private:
+    friend class elliptec;
+    ell_handle(elliptec &ell, std::string addr, ell_converter<unit_type> conv) : _ell(ell), _addr(std::move(addr)), _conv(conv) {}
+
+    elliptec &_ell;
+    std::string _addr;
+    ell_converter<unit_type> _conv;     //pulses per rev or per mm, stages only
+
+    double to_units(Steps steps) const { return _conv.to_units(steps).value; }
+    Steps motion(const std::string &cmd, bool needs_home) {
+        return Steps(_ell.hex2step(_ell.handle_command(_addr, _addr + cmd, "PO", true, needs_home)));
+    }
+    double paddle_motion(uint8_t paddle, const std::string &cmd, const std::string &data) {
+        if ((paddle < 1) || (paddle > 3)) {
+            throw std::invalid_argument("paddle has to be 1, 2 or 3");
+        }
+        std::string num = std::to_string(paddle);
+        return elliptec::PADDLE_DEG_PER_STEP*_ell.hex2step(_ell.handle_command(_addr, _addr + cmd + num + data, "P" + num, true));
+    }
+};
+
+template <ell_device_kind K>
+ell_handle<K> elliptec::handle(std::string addr) {
+    static const char *types[] = {"rotary", "linear", "paddle", "piezo"};
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    if (!devintype(types[K], dev.value().type)) {
+        throw std::invalid_argument("Device with address " + addr + " is not " + types[K]);
+    }
+    if constexpr (K == KIND_ROTARY || K == KIND_LINEAR) {
+        return ell_handle<K>(*this, addr, ell_converter<typename ell_handle<K>::unit_type>(dev.value().pulses));
+    } else {
+        return ell_handle<K>(*this, addr, {});
+    }
+}
+
 #endif // ELLIPTEC_H
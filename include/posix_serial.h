@@ -0,0 +1,44 @@
+#ifndef POSIX_SERIAL_H
+#define POSIX_SERIAL_H
+
+/*! \file */
+
+#include "ell_transport.h"
+
+#include <string>
+
+/**
+ * Serial port on a raw termios file descriptor, read through fd_transport.
+ *
+ * On USB-serial adapters the driver's receive latency usually dominates
+ * short round trips; open() therefore sets ASYNC_LOW_LATENCY and, for FTDI
+ * adapters, lowers /sys/bus/usb-serial/devices/<tty>/latency_timer (16 ms
+ * by default). Both are best effort: they need a cooperating driver and
+ * write access to sysfs. The original latency timer is restored on close().
+ */
+class Posix_serial : public fd_transport {
+public:
+    explicit Posix_serial(bool low_latency = true, int ftdi_latency_ms = 1);
+    ~Posix_serial() override;
+
+    void open(const std::string &devname, unsigned int baud_rate) override;
+    void close() override;
+    void flush() override;
+
+    /**
+     * \return FTDI latency timer in ms in effect, -1 if unknown
+     */
+    int latencyTimer() const;
+
+private:
+    bool _low_latency;
+    int _ftdi_latency_ms;
+    std::string _latency_path;      //sysfs latency_timer of the adapter
+    int _latency_orig = -1;
+    int _latency_set = -1;
+
+    void set_low_latency();
+    void set_ftdi_latency(const std::string &devname);
+};
+
+#endif // POSIX_SERIAL_H
@@ -26,6 +26,9 @@
 #include <algorithm>
 #include <iostream>
 #include <boost/bind.hpp>
+#ifndef _WIN32
+#include <termios.h>
+#endif
 
 using namespace std;
 using namespace boost;
@@ -69,6 +72,14 @@ void Boost_serial::close()
     port.close();
 }
 
+void Boost_serial::flush()
+{
+    #ifndef _WIN32
+    if(isOpen()) ::tcflush(port.native_handle(),TCIFLUSH);
+    #endif
+    readData.consume(readData.size());
+}
+
 void Boost_serial::setTimeout(const boost::posix_time::time_duration& t)
 {
     timeout=t;
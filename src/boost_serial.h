@@ -90,6 +90,11 @@ public:
      */
     void close();
 
+    /**
+     * Discard data received but not yet read
+     */
+    void flush();
+
     /**
      * Set the timeout on read/write operations.
      * To disable the timeout, call setTimeout(boost::posix_time::seconds(0));
@@ -1,9 +1,14 @@
 #include "ell.h"
 
-elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids, const bool dohome, const bool freqsearch) : _inmids{std::move(inmids)}, _devname(devname)
+elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids, const bool dohome, const bool freqsearch) : elliptec(devname, inmids, dohome ? HOME_ALWAYS : HOME_NEVER, freqsearch)
 {
-    _dohome = dohome;
+}
+
+elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids, const ell_home_policy home_policy, const bool freqsearch, const std::string state_path, const ell_transport_config transport) : _inmids{std::move(inmids)}, _devname(devname), _state_path(state_path)
+{
+    _dohome = (home_policy == HOME_ALWAYS);
     _dofreqsearch = freqsearch;
+    _home_policy = home_policy;
     
     devtype["rotary"] = {8, 14, 18};
     devtype["linear"] = {7, 10, 17, 20};
@@ -14,6 +19,7 @@ elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids,
     devtype["piezo"] = {5};
 
     _ser_timeout = 5;
+    _last_activity = std::chrono::steady_clock::now();
     
     if (_inmids.size() > 1) {
         std::sort(_inmids.begin(), _inmids.end());
@@ -28,22 +34,42 @@ elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids,
         }
     }
     
-    bserial = std::unique_ptr<Boost_serial>(new Boost_serial(_devname, 9600,
-                               boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
-                               boost::asio::serial_port_base::character_size(8),
-                               boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none),
-                               boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one)));
+    bserial = make_transport(transport);
+    bserial->open(_devname, 9600);
     bserial->setTimeout(boost::posix_time::seconds(30));
 
     open(_devname);
+
+    // no ids given: use whatever answers on the bus
+    const bool scanned = _inmids.empty();
+    if (scanned) {
+        for (const ell_device &dev : scan_bus()) {
+            _inmids.push_back(std::stoi(dev.address, nullptr, 16));
+            mids.push_back(dev.address);
+        }
+        std::cout << "found " << mids.size() << " devices on the bus" << std::endl;
+    }
     
+    std::unordered_map<uint64_t, int64_t> saved = load_state();
     for (std::string id : mids) {
-        get_info(id);
+        if (!scanned) {
+            get_info(id);
+        }
         if (freqsearch) {
             search_freq(id);
             //save_userdata(id);
         }
-        if (dohome) {
+        if ((home_policy == HOME_IF_NEEDED) || (home_policy == HOME_LAZY)) {
+            if (!position_trusted(id, saved)) {
+                if (home_policy == HOME_LAZY) {
+                    _needs_home.push_back(id);
+                } else {
+                    home(id);
+                }
+            }
+            continue;
+        }
+        if (_dohome) {
             home(id);
         }
         get_position(id);
@@ -53,11 +79,30 @@ elliptec::elliptec(const std::string devname, const std::vector<uint8_t> inmids,
 
 elliptec::~elliptec()
 {
+    stop_health_monitor();
+    stop_reader();
+    if (_state_path != "") {
+        try {
+            save_state();
+        } catch (std::exception &ex) {
+            std::cout << ex.what() << std::endl;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        _jobs_stop = true;
+    }
+    _jobcv.notify_all();
+    if (_jobthread.joinable()) {
+        _jobthread.join();
+    }
     bserial->close();
 }
 
 std::optional<ell_device> elliptec::devinfo_at_addr(std::string addr) {
-    std::cout << "number of connected devices: " << devices.size() << std::endl;
+    if (!_background_io && !_quiet) {
+        std::cout << "number of connected devices: " << devices.size() << std::endl;
+    }
     for (ell_device d : devices) {
         if (d.address == addr) {
             return d;
@@ -101,14 +146,19 @@ ell_response elliptec::process_response(std::string response) {
     } else if (!command.compare(std::string("PO"))) {
         auto dev = devinfo_at_addr(addstr);
         int64_t step = hex2step(ret.data);
+        _positions[addstr] = step;
         double pos = 0;
         if (devislinear(addstr)) {
             pos = step2mm(addstr, step);
-            std::cout << pos << "mm" << std::endl;
+            if (!_quiet) {
+                std::cout << pos << "mm" << std::endl;
+            }
             _current_pos = pos;
         } else if (devisrotary(addstr)) {
             pos = step2deg(addstr, step);
-            std::cout << pos << "deg" << std::endl;
+            if (!_quiet) {
+                std::cout << pos << "deg" << std::endl;
+            }
             _current_pos = pos;
         } 
     } else if (!command.compare(std::string("GJ"))) {
@@ -117,19 +167,38 @@ ell_response elliptec::process_response(std::string response) {
         double jogsize = 0;
         if (devislinear(addstr)) {
             jogsize = step2mm(addstr, step);
-            std::cout << "jogsize: " << jogsize << "mm" << std::endl;
+            if (!_quiet) {
+                std::cout << "jogsize: " << jogsize << "mm" << std::endl;
+            }
         } else if (devisrotary(addstr)) {
             jogsize = step2deg(addstr, step);
-            std::cout << "jogsize: " << jogsize << "deg" << std::endl;
+            if (!_quiet) {
+                std::cout << "jogsize: " << jogsize << "deg" << std::endl;
+            }
         } 
+    } else if (!command.compare(std::string("HO"))) {
+        int64_t step = hex2step(ret.data);
+        if (devislinear(addstr)) {
+            if (!_quiet) {
+                std::cout << "home offset: " << step2mm(addstr, step) << "mm" << std::endl;
+            }
+        } else if (devisrotary(addstr)) {
+            if (!_quiet) {
+                std::cout << "home offset: " << step2deg(addstr, step) << "deg" << std::endl;
+            }
+        }
     } else if (!command.compare(std::string("GV"))) {
         auto dev = devinfo_at_addr(addstr);
         uint64_t percent = hex2step(ret.data);
-        std::cout << "speed: " << percent << "%" << std::endl; 
+        if (!_quiet) {
+            std::cout << "speed: " << percent << "%" << std::endl;
+        }
     } else if ((!command.compare(std::string("P1"))) || (!command.compare(std::string("P2"))) || (!command.compare(std::string("P3")))) {
         uint8_t pnum = std::stoi(command.substr(1,1).data(), nullptr, 10);
         
-        std::cout << "Paddle " << unsigned(pnum) << " position: " << 3.0*hex2step(ret.data) << "deg" << std::endl;
+        if (!_quiet) {
+            std::cout << "Paddle " << unsigned(pnum) << " position: " << PADDLE_DEG_PER_STEP*hex2step(ret.data) << "deg" << std::endl;
+        }
         return ret;
     } else {
         throw std::runtime_error("Return code not recognized: " + response);
@@ -144,67 +213,73 @@ ell_response elliptec::process_response(std::string response) {
  *
  *****************************************/
 void elliptec::get_info(std::string addr){
-    std::string msg = addr + "in";
-    write(msg.data());
-    
-    std::string response = read();
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::string response = cached_query(addr, "in", "IN");
     if (response.substr(1,2).compare(std::string("IN")) == 0) {
-        std::string addstr = response.substr(0,1);
-        uint16_t type   = std::stoi(response.substr(3,2).data(),  nullptr, 16);
-        uint64_t sn     = std::stoi(response.substr(5,8).data(),  nullptr, 10);
-        uint16_t year   = std::stoi(response.substr(13,4).data(), nullptr, 10);
-        uint8_t fwrel   = std::stoi(response.substr(17,2).data(), nullptr, 10);
-        uint8_t hwrel   = std::stoi(response.substr(19,2).data(), nullptr, 10);
-        uint16_t travel = std::stoi(response.substr(21,4).data(), nullptr, 16);
-        uint64_t pulses = std::stoi(response.substr(25,8).data(), nullptr, 16);
-
-        ell_device dev;
-        dev.address = addstr;
-        dev.type = type;
-        dev.serial = sn;
-        dev.year = year;
-        dev.fw = fwrel;
-        dev.hw = hwrel;
-        dev.travel = travel;
-        dev.pulses = pulses;
-        handle_devinfo(dev);
+        handle_devinfo(parse_devinfo(response));
     }
     //reply with info response
 }
 
-void elliptec::get_motor_info(std::string addr, uint8_t motor_num){
+ell_motor_info elliptec::get_motor_info(std::string addr, uint8_t motor_num){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if ((motor_num > 3) || (motor_num < 1)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     } 
-    std::string msg = addr + "i" + std::to_string(motor_num);
-    write(msg.data());
-    
-    std::string response = read();
-    if ((response.substr(1,2).compare(std::string("I1"))) || (response.substr(1,2).compare(std::string("I2"))) || (response.substr(1,2).compare(std::string("I3")))) {
-        uint8_t ret_mnum    = std::stoi(response.substr(0,1).data(),  nullptr, 16);
-        uint8_t loopOn      = std::stoi(response.substr(3,1).data(),  nullptr, 10);
-        uint8_t motorOn     = std::stoi(response.substr(4,1).data(),  nullptr, 10);
-        uint16_t current    = std::stoi(response.substr(5,4).data(),  nullptr, 16);
-        uint16_t rampUp     = std::stoi(response.substr(9,4).data(),  nullptr, 16);
-        uint16_t rampDown   = std::stoi(response.substr(13,4).data(), nullptr, 16);
-        uint16_t periodFwd  = std::stoi(response.substr(17,4).data(), nullptr, 16);
-        uint16_t periodBwd  = std::stoi(response.substr(21,4).data(), nullptr, 16);
-        
-        std::cout << "Motor " << ret_mnum << " info\n";
-        std::cout << "Loop on       : " << unsigned(loopOn) << "\n";
-        std::cout << "Motor on      : " << unsigned(motorOn) << "\n";
-        std::cout << "Current       : " << 1.0*current/1.866 << "mA\n";
-        std::cout << "Ramp up       : " << rampUp << " PWM increase / ms\n";
-        std::cout << "Ramp down     : " << rampDown << " PWM decrease / ms\n";
-        std::cout << "Fwd frequency : " << 14740000.0/periodFwd << " kHz\n";
-        std::cout << "Bwd frequency : " << 14740000.0/periodBwd << " kHz\n";
+    std::string num = std::to_string(motor_num);
+    std::string response = cached_query(addr, "i" + num, "I" + num);
+    ell_motor_info info;
+    if (!response.substr(1,2).compare("I" + std::to_string(motor_num))) {
+        info = parse_motor_info(response);
+        std::cout << "Motor " << unsigned(info.motor) << " info\n";
+        std::cout << "Loop on       : " << unsigned(info.loop_on) << "\n";
+        std::cout << "Motor on      : " << unsigned(info.motor_on) << "\n";
+        std::cout << "Current       : " << 1.0*info.current/1.866 << "mA\n";
+        std::cout << "Ramp up       : " << info.ramp_up << " PWM increase / ms\n";
+        std::cout << "Ramp down     : " << info.ramp_down << " PWM decrease / ms\n";
+        std::cout << "Fwd frequency : " << 14740000.0/info.period_fwd << " kHz\n";
+        std::cout << "Bwd frequency : " << 14740000.0/info.period_bwd << " kHz\n";
         std::cout << std::endl;
     } else {
         process_response(response);
     }
+    return info;
+}
+
+ell_device elliptec::parse_devinfo(const std::string &response) {
+    if (response.length() < 33) {
+        throw std::runtime_error("bad device response:\n"+response);
+    }
+    ell_device dev;
+    dev.address = response.substr(0,1);
+    dev.type    = std::stoi(response.substr(3,2).data(),  nullptr, 16);
+    dev.serial  = std::stoi(response.substr(5,8).data(),  nullptr, 10);
+    dev.year    = std::stoi(response.substr(13,4).data(), nullptr, 10);
+    dev.fw      = std::stoi(response.substr(17,2).data(), nullptr, 10);
+    dev.hw      = std::stoi(response.substr(19,2).data(), nullptr, 10);
+    dev.travel  = std::stoi(response.substr(21,4).data(), nullptr, 16);
+    dev.pulses  = std::stoi(response.substr(25,8).data(), nullptr, 16);
+    return dev;
+}
+
+ell_motor_info elliptec::parse_motor_info(const std::string &response) {
+    if (response.length() < 25) {
+        throw std::runtime_error("bad device response:\n"+response);
+    }
+    ell_motor_info info;
+    info.motor      = std::stoi(response.substr(2,1).data(),  nullptr, 10);
+    info.loop_on    = std::stoi(response.substr(3,1).data(),  nullptr, 10);
+    info.motor_on   = std::stoi(response.substr(4,1).data(),  nullptr, 10);
+    info.current    = std::stoi(response.substr(5,4).data(),  nullptr, 16);
+    info.ramp_up    = std::stoi(response.substr(9,4).data(),  nullptr, 16);
+    info.ramp_down  = std::stoi(response.substr(13,4).data(), nullptr, 16);
+    info.period_fwd = std::stoi(response.substr(17,4).data(), nullptr, 16);
+    info.period_bwd = std::stoi(response.substr(21,4).data(), nullptr, 16);
+    return info;
 }
 
 void elliptec::set_motor_freq(std::string addr, std::string dir, uint8_t motor_num, uint16_t freq_khz, bool factory_reset){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr;
     if ((motor_num > 3) || (motor_num < 1)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
@@ -250,6 +325,7 @@ void elliptec::search_motor_freq(std::string addr, uint8_t motor_num){
 }
 
 void elliptec::scan_motor_current_curve(std::string addr, uint8_t motor_num) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if ((motor_num > 3) || (motor_num < 1)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     }
@@ -259,64 +335,74 @@ void elliptec::scan_motor_current_curve(std::string addr, uint8_t motor_num) {
     //reply with GS
 }
 
-std::vector<std::pair<uint8_t, uint8_t>> elliptec::get_motor_current_curve(std::string addr, uint8_t motor_num) {
+std::vector<std::pair<uint8_t, uint16_t>> elliptec::get_motor_current_curve(std::string addr, uint8_t motor_num) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::vector<std::pair<uint8_t, uint16_t>> result;
+    ell_curve_record rec{};
+    if (read_motor_current_curve(addr, motor_num, rec)) {
+        result.reserve(ELL_CURVE_POINTS);
+        for (size_t i=0; i<ELL_CURVE_POINTS; ++i) {
+            result.push_back({rec.period[i], rec.current[i]});
+        }
+    }
+    return result;
+}
+
+bool elliptec::read_motor_current_curve(std::string addr, uint8_t motor_num, ell_curve_record &rec) {
     if ((motor_num > 3) || (motor_num < 1)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     }
     std::string msg = addr + "C" + std::to_string(motor_num);
     write(msg.data());
     std::string response = read();
-    uint8_t period = 0;
-    uint8_t current = 0;
-    std::pair<uint8_t, uint8_t> p = {0, 0};
-    std::vector<std::pair<uint8_t, uint8_t>> result;
     if (response.substr(1,2) == "C" + std::to_string(motor_num)) {
-        std::string payload = response.substr(3,response.npos);
-        if (payload.length() < 522) {
+        if (!ell_curve_decode(std::string_view(response).substr(3), rec.period, rec.current)) {
             throw std::runtime_error("bad device response:\n"+response);
         }
-        for (uint8_t i=0; i<87; ++i) {
-            period = std::stoi(payload.substr(0+6*i,2).data(), nullptr, 10);
-            current = std::stoi(payload.substr(2+6*i,4).data(), nullptr, 10);;
-            p = {period, current};
-            result.push_back(p);
-        }
-    } else {
-        process_response(response);
+        rec.address = std::stoi(response.substr(0,1).data(), nullptr, 16);
+        rec.motor = motor_num;
+        return true;
     }
-    
-    return result;
+    process_response(response);
+    return false;
 }
 
 void elliptec::isolate_device(std::string addr, uint8_t minutes){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "is" + uc2hex(minutes);
     write(msg.data());
     //no response
 }
 
 void elliptec::home(std::string addr, std::string dir) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
+    std::erase(_needs_home, addr);
     std::string msg = addr + "ho" + dir;
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with GS (while moving) or PO
 }
 
 void elliptec::paddle_home(std::string addr, uint8_t paddle_num) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     if ((paddle_num < 1) || (paddle_num > 7)) {
         throw std::invalid_argument("Paddle specifyer has to be 1...7");
     } else {
         
     }
     std::string msg = addr + "ho" + std::to_string(paddle_num);
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with GS (while moving) or PO
 }
 
-// TODO: This assumes that, after trying to move to position, 
-// ell_response ret = process_response() is returning a position. 
-// Harden.
+// motion_response() waits through busy frames for the final reply. An
+// error reply instead of PO fails the position check and is retried.
 void elliptec::move_absolute(std::string addr, double pos) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr, true);
     std::string msg = addr + "ma";
     std::string hstepstr = "";
     auto dev = devinfo_at_addr(addr);
@@ -340,15 +426,15 @@ void elliptec::move_absolute(std::string addr, double pos) {
         msg += hstepstr;
 
         uint8_t retcnt = 0;
-        uint64_t steps = 0;
+        int64_t steps = 0;
         double ERR=0;
         double retpos=0;
         while (retcnt < 5) {
             steps=0;
             retpos=0;
             ERR=0;
-            write(msg.data());
-            ell_response ret = process_response();
+            motion_write(msg);
+            ell_response ret = motion_response();
             steps = hex2step(ret.data);
             if (devintype("linear", devinfo_at_addr(addr)->type)) {
                 ERR = MMERR;
@@ -357,11 +443,19 @@ void elliptec::move_absolute(std::string addr, double pos) {
                 ERR = DEGERR;
                 retpos = step2deg(addr, steps);
             }
+            if (stop_requested(addr)) {
+                if (!_quiet) {
+                    std::cout << "stopped at " << retpos << std::endl;
+                }
+                break;
+            }
             if (std::abs(pos-retpos) > ERR) {
                 std::cout << "ERROR: rotation failed: moved " << retpos << " while trying to move " << pos << std::endl;
                 ++retcnt;
             } else {
-                std::cout << "rotation succeeded: moved " << retpos << " while trying to move " << pos << std::endl;
+                if (!_quiet) {
+                    std::cout << "rotation succeeded: moved " << retpos << " while trying to move " << pos << std::endl;
+                }
                 retcnt = 5;
             }
         }
@@ -369,10 +463,11 @@ void elliptec::move_absolute(std::string addr, double pos) {
     //reply with GS (while moving) or PO
 }
 
-// TODO: This assumes that, after trying to move to position, 
-// ell_response ret = process_response() is returning a position. 
-// Harden.
+// motion_response() waits through busy frames for the final reply. An
+// error reply instead of PO fails the position check and is retried.
 void elliptec::move_relative(std::string addr, double pos) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr, true);
     std::string msg = addr + "mr";
     std::string hstepstr = "";
     auto dev = devinfo_at_addr(addr);
@@ -397,13 +492,13 @@ void elliptec::move_relative(std::string addr, double pos) {
         msg += hstepstr;
 
         uint8_t retcnt = 0;
-        uint64_t steps = 0;
+        int64_t steps = 0;
         double ERR = 0;
         double retpos = 0;
         double oldpos = _current_pos;
         while (retcnt < 5) {
-            write(msg.data());
-            ell_response ret = process_response();
+            motion_write(msg);
+            ell_response ret = motion_response();
             steps = hex2step(ret.data);
             ERR=0;
             retpos=0;
@@ -414,11 +509,19 @@ void elliptec::move_relative(std::string addr, double pos) {
                 ERR = DEGERR;
                 retpos = step2deg(addr, steps);
             }
+            if (stop_requested(addr)) {
+                if (!_quiet) {
+                    std::cout << "stopped at " << retpos << std::endl;
+                }
+                break;
+            }
             if (std::abs(retpos-oldpos-pos) > ERR) {
                 std::cout << "ERROR: rotation failed: moved " << retpos-oldpos << " while trying to move " << pos<< std::endl;
                 ++retcnt;
             } else {
-                std::cout << "rotation succeeded: moved " << retpos-oldpos << " while trying to move " << pos  << std::endl;
+                if (!_quiet) {
+                    std::cout << "rotation succeeded: moved " << retpos-oldpos << " while trying to move " << pos  << std::endl;
+                }
                 retcnt = 5;
             }
         }
@@ -428,6 +531,7 @@ void elliptec::move_relative(std::string addr, double pos) {
 
 
 double elliptec::get_home_offset(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     auto dev = devinfo_at_addr(addr);
     if (dev.has_value()){
         if (!devintype("linrot", dev.value().type)) {
@@ -436,12 +540,11 @@ double elliptec::get_home_offset(std::string addr) {
     } else {
         throw std::runtime_error("Device with address " + addr + " not in connected device list");
     }
-    std::string msg = addr + "go";
-    write(msg.data());
-    std::string response = read();
+    std::string response = cached_query(addr, "go", "HO");
+    process_response(response);
     double home_offset = 0;
-    if (response.substr(1,2).compare(std::string("HO"))) {
-        uint64_t pulses = hex2step(response.substr(2,8));
+    if (!response.substr(1,2).compare(std::string("HO"))) {
+        int64_t pulses = hex2step(response.substr(3,8));
         if (devintype("linear", devinfo_at_addr(addr)->type)) {
             home_offset = step2mm(addr, pulses);
         } else {
@@ -455,6 +558,7 @@ double elliptec::get_home_offset(std::string addr) {
 }
 
 void elliptec::set_home_offset(std::string addr, double offset) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string hexoffset = "";
     if (devislinear(addr)) {
         hexoffset = step2hex(mm2step(addr, offset));
@@ -465,20 +569,23 @@ void elliptec::set_home_offset(std::string addr, double offset) {
     }
     std::string msg = addr + "so" + hexoffset;
     write(msg.data());
-    process_response();
+    ell_response ret = process_response();
+    if (!ret.type.compare("GS") && (parsestatus(int2addr(ret.address) + ret.type + ret.data) == OK)) {
+        cache_setting(addr, "go", "HO" + hexoffset);
+    }
     //no response ?
 }
 
 double elliptec::get_jogstep_size(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if (!devislinrot(addr)) {
         throw std::invalid_argument("Only linear and rotary devices support home offset");
     }
-    std::string msg = addr + "gj";
-    write(msg.data());
-    std::string response = read();
+    std::string response = cached_query(addr, "gj", "GJ");
+    process_response(response);
     double jss = 0;
-    if (response.substr(1,2).compare(std::string("GJ"))) {
-        uint64_t pulses = hex2step(response.substr(2,8));
+    if (!response.substr(1,2).compare(std::string("GJ"))) {
+        int64_t pulses = hex2step(response.substr(3,8));
         if (devintype("linear", devinfo_at_addr(addr)->type)) {
             jss = step2mm(addr, pulses);
         } else {
@@ -493,6 +600,7 @@ double elliptec::get_jogstep_size(std::string addr) {
 }
 
 void elliptec::set_jogstep_size(std::string addr, double jss) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string hexjss = "";
     if (devislinear(addr)) {
         hexjss = step2hex(mm2step(addr, jss));
@@ -503,67 +611,149 @@ void elliptec::set_jogstep_size(std::string addr, double jss) {
     }
     std::string msg = addr + "sj" + hexjss;
     write(msg.data());
-    process_response();
+    ell_response ret = process_response();
+    if (!ret.type.compare("GS") && (parsestatus(int2addr(ret.address) + ret.type + ret.data) == OK)) {
+        cache_setting(addr, "gj", "GJ" + hexjss);
+    }
     //no response ?
 }
 
 void elliptec::move_fwd(std::string addr){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr, true);
     std::string msg = addr + "fw";
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with GS (while moving) or PO
 }
 
 void elliptec::move_bwd(std::string addr){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr, true);
     std::string msg = addr + "bw";
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with GS (while moving) or PO
 }
 
 void elliptec::stop(std::string addr){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     std::string msg = addr + "ms";
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with PO
 }
 
-void elliptec::get_position(std::string addr) {
+// stop() as soon as possible, also while another thread holds the bus for
+// a motion that may take long to finish or time out. Where the transport
+// allows writing during a read, ms goes out at once: its PO ends the
+// holder's motion if that is on addr and is dropped otherwise. Elsewhere
+// the holder's read is cancelled, its command fails, and stop() follows
+// as soon as the bus is free.
+void elliptec::stop_now(std::string addr) {
+    std::unique_lock<std::recursive_mutex> lock(_busmtx, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        if (bserial->concurrent_io()) {
+            {
+                std::lock_guard<std::mutex> stoplock(_stopmtx);
+                _stop_requests.push_back(addr);
+                if (!_reader_running) {
+                    // the reader thread drops replies nobody waits for
+                    _stop_pending.push_back(addr);
+                }
+            }
+            std::lock_guard<std::mutex> writelock(_writemtx);
+            bserial->write_frame(addr + "ms");
+            return;
+        }
+        bserial->cancel();
+        lock.lock();
+        bserial->clear_cancel();
+    }
+    stop(addr);
+}
+
+// Whether stop_now() reached addr during the last motion written to it.
+// Retrying moves give up then.
+bool elliptec::stop_requested(const std::string &addr) {
+    std::lock_guard<std::mutex> lock(_stopmtx);
+    return std::find(_stop_requests.begin(), _stop_requests.end(), addr) != _stop_requests.end();
+}
+
+// The PO answering a stop_now() ms is a stray unless the device it comes
+// from is the one a motion waits for.
+bool elliptec::route_stop_reply(std::string_view response) {
+    if ((response.length() < 3) || response.substr(1,2).compare("PO")) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_stopmtx);
+    auto it = std::find(_stop_pending.begin(), _stop_pending.end(), response.substr(0,1));
+    if (it == _stop_pending.end()) {
+        return false;
+    }
+    _stop_pending.erase(it);
+    return response.substr(0,1).compare(_expect_addr) != 0;
+}
+
+double elliptec::get_position(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "gp";
+    auto last = _positions.find(addr);
+    int64_t before = (last != _positions.end()) ? last->second : 0;
     write(msg.data());
-    process_response();
+    ell_response ret = process_response();
+    if (ret.type.compare(std::string("PO"))) {
+        return std::nan("");
+    }
+    int64_t step = hex2step(ret.data);
+    if ((step == 0) && (before != 0)) {
+        // counter back at zero without a motion in between
+        power_cycled(addr);
+    }
+    if (devislinear(addr)) {
+        return step2mm(addr, step);
+    } else if (devisrotary(addr)) {
+        return step2deg(addr, step);
+    }
+    return step;
     //reply with GS (while moving) or PO
 }
 
 uint8_t elliptec::get_velocity(std::string addr) {
-    std::string msg = addr + "gv";
-    write(msg.data());
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     uint8_t percent = 0;
-    std::string response = read();
-    if (response.substr(1,2).compare(std::string("GV"))) {
+    std::string response = cached_query(addr, "gv", "GV");
+    process_response(response);
+    if (!response.substr(1,2).compare(std::string("GV"))) {
         percent = uint8_t(hex2step(response.substr(3,2)));
-    } else {
-        process_response(response);
     }
     return percent; 
     //reply with GV
 }
 
 void elliptec::set_velocity(std::string addr, uint8_t percent) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "sv" + uc2hex(percent);
     write(msg.data());
-    process_response();
+    ell_response ret = process_response();
+    if (!ret.type.compare("GS") && (parsestatus(int2addr(ret.address) + ret.type + ret.data) == OK)) {
+        cache_setting(addr, "gv", "GV" + uc2hex(percent));
+    }
     //no reply?
 }
 
 void elliptec::groupaddress(std::string addr, std::string groupaddr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "ga" + groupaddr;
-    write(msg.data());
+    write(msg.data(), groupaddr);
     process_response();
     //reply with GS
 }
 
 void elliptec::paddle_drivetime(std::string addr, uint8_t padnum, uint16_t ms, std::string direction){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     if ((padnum < 1) || (padnum > 3)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     }
@@ -578,46 +768,53 @@ void elliptec::paddle_drivetime(std::string addr, uint8_t padnum, uint16_t ms, s
         time[0] = '8';
     }
     std::string msg = addr + "t" + std::to_string(padnum) + time;
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with P1/P2/P3 (position) or error
 }
 
 void elliptec::paddle_moveabsolute(std::string addr, uint8_t padnum, double deg){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     if ((padnum < 1) || (padnum > 3)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     }
     if (!devispaddle(addr)) {
         throw std::invalid_argument("only paddles support command -paddle_moveabsolute-");
     }
-    uint32_t step = std::lround(deg/0.33);
+    uint32_t step = std::lround(deg/PADDLE_DEG_PER_STEP);
     std::string msg = addr + "a" + std::to_string(padnum) + step2hex(step, 4);
-    write(msg.data());
-    process_response();
+    motion_write(msg);
+    motion_response();
     //reply with P1/P2/P3 (position) or error
 }
 
 void elliptec::paddle_moverelative(std::string addr, uint8_t padnum, double deg){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     if ((padnum < 1) || (padnum > 3)) {
         throw std::invalid_argument("motor_num has to be 1, 2 or 3");
     }
     if (!devispaddle(addr)) {
         throw std::invalid_argument("only paddles support command -paddle_moverelative-");
     }
-    int32_t step = std::lround(deg/0.33);
-    std::string msg = addr + "r" + std::to_string(padnum) + step2hex(step, 4);
-    write(msg.data());
-    process_response();
+    int32_t step = std::lround(deg/PADDLE_DEG_PER_STEP);
+    //16 bit two's complement, step2hex would give 8 digits for a negative distance
+    std::string msg = addr + "r" + std::to_string(padnum) + step2hex(step & 0xFFFF, 4);
+    motion_write(msg);
+    motion_response();
     //reply with P1/P2/P3 (position) or error
 }
 
 void elliptec::save_userdata(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "us";
     write(msg.data());
     process_response();
 }
 
 void elliptec::optimize_motors(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "om";
     write(msg.data());
     bserial->setTimeout(boost::posix_time::seconds(0));
@@ -627,6 +824,7 @@ void elliptec::optimize_motors(std::string addr) {
 }
 
 void elliptec::clean_mechanics(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "cm";
     write(msg.data());
     bserial->setTimeout(boost::posix_time::seconds(0));
@@ -636,6 +834,7 @@ void elliptec::clean_mechanics(std::string addr) {
 }
 
 void elliptec::stop_clean(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "st";
     write(msg.data());
     process_response();
@@ -643,57 +842,64 @@ void elliptec::stop_clean(std::string addr) {
 }
 
 void elliptec::change_address(std::string addr, std::string newaddr) {
-    bool found = false;
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    if (readdress(addr, newaddr)) {
+        save_userdata(newaddr);
+        for (auto &dev: devices) {
+            print_dev_info(dev);
+        }
+    }
+}
+
+// ca without us; the new address is lost at power off unless saved
+bool elliptec::readdress(std::string addr, std::string newaddr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     for (auto dev: devices) {
         if (dev.address == newaddr) {
             std::cout << "Error: new address " << newaddr << " already in use" << std::endl;
-            found = true;
+            return false;
         }
     }
-    if (!found) {
-        std::string msg = addr + "ca" + newaddr;
-        write(msg.data());
-        process_response();
-        save_userdata(newaddr);
-        for (auto &dev:devices) { 
-            if (dev.address==addr) {
-                dev.address=newaddr;
-            }
-        }
-        for (auto &dev: devices) {
-            print_dev_info(dev);
+    std::string msg = addr + "ca" + newaddr;
+    write(msg.data(), newaddr);
+    process_response();
+    for (auto &dev:devices) { 
+        if (dev.address==addr) {
+            dev.address=newaddr;
         }
-        for (size_t i=0; i< mids.size(); ++i) {
-            if (mids.at(i) == addr) {
-                mids.at(i) = newaddr;
-            }
+    }
+    for (size_t i=0; i< mids.size(); ++i) {
+        if (mids.at(i) == addr) {
+            mids.at(i) = newaddr;
         }
     }
+    return true;
 }
 
-void elliptec::get_status(std::string addr) {
+uint8_t elliptec::get_status(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     std::string msg = addr + "gs";
     write(msg.data());
-    process_response();
+    std::string response = read();
+    process_response(response);
+    return parsestatus(response);
     //reply with GS
 }
 
 void elliptec::energize_motor(std::string addr, double freq_hz){
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
     if (!devispiezo(addr)) {
         throw std::invalid_argument("only piezo ELL5 can be energized");
     }
-    if ((freq_hz < 230) || (freq_hz > 2000000)) {
-        throw std::invalid_argument("Frequency needs to be between 23Hz and 2MHz");
-    }
-    uint32_t period = std::llround(14740000/freq_hz);
-    
-    std::string msg = addr + "e1" + step2hex(period,4);
+    std::string msg = piezo_frame(addr, freq_hz);
     write(msg.data());
     process_response();
     //reply with GS
 }
 
 void elliptec::halt_motor(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if (!devispiezo(addr)) {
         throw std::invalid_argument("only piezo ELL5 can halt");
     }
@@ -710,6 +916,7 @@ void elliptec::halt_motor(std::string addr) {
  *
  *****************************************/
 void elliptec::search_freq(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     auto dev = devinfo_at_addr(addr);
     if (dev.has_value()){
         if (devintype("indexed", dev.value().type)) {
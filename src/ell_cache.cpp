@@ -0,0 +1,119 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Settings cache
+ *
+ *****************************************/
+// The cache keeps the last reply to each settings query (gv, gj, go, in,
+// i1...i3) per device. Replies are stored as received, so a cached getter
+// parses and prints exactly as if the device had answered.
+std::string elliptec::cached_query(const std::string &addr, const std::string &query, const std::string &reply) {
+    auto dev = _settings.find(addr);
+    if (dev != _settings.end()) {
+        auto it = dev->second.find(query);
+        if (it != dev->second.end()) {
+            return it->second;
+        }
+    }
+    write(addr + query);
+    std::string response = read();
+    if (!response.substr(1,2).compare(reply)) {
+        _settings[addr][query] = response;
+    }
+    return response;
+}
+
+// reply as the device would send it after a successful setter
+void elliptec::cache_setting(const std::string &addr, const std::string &query, const std::string &reply) {
+    _settings[addr][query] = addr + reply;
+}
+
+std::optional<uint8_t> elliptec::cached_velocity(const std::string &addr) {
+    auto dev = _settings.find(addr);
+    if (dev != _settings.end()) {
+        auto it = dev->second.find("gv");
+        if (it != dev->second.end()) {
+            return uint8_t(hex2step(it->second.substr(3,2)));
+        }
+    }
+    return std::nullopt;
+}
+
+// query "" forgets every setting of addr
+void elliptec::forget_settings(const std::string &addr, const std::string &query) {
+    if (query.empty()) {
+        _settings.erase(addr);
+        return;
+    }
+    auto dev = _settings.find(addr);
+    if (dev != _settings.end()) {
+        dev->second.erase(query);
+    }
+}
+
+// Called for every frame written: whatever a command may change is
+// forgotten before it goes out, setters put the new value back once the
+// device confirmed it. Frequency searches change the motor periods, and
+// so may optimizing and cleaning, which retune both motors; ca moves the
+// device away from both addresses.
+void elliptec::forget_written(const std::string &frame, const std::string &reply_from) {
+    if (frame.length() < 3) {
+        return;
+    }
+    std::string addr = frame.substr(0,1);
+    std::string cmd = frame.substr(1,2);
+    if (!cmd.compare("sv")) {
+        forget_settings(addr, "gv");
+    } else if (!cmd.compare("sj")) {
+        forget_settings(addr, "gj");
+    } else if (!cmd.compare("so")) {
+        forget_settings(addr, "go");
+    } else if (((cmd[0] == 'f') || (cmd[0] == 'b') || (cmd[0] == 's')) && (cmd[1] >= '1') && (cmd[1] <= '3')) {
+        forget_settings(addr, std::string("i") + cmd[1]);
+    } else if (!cmd.compare("om") || !cmd.compare("cm")) {
+        forget_settings(addr, "i1");
+        forget_settings(addr, "i2");
+    } else if (!cmd.compare("ca")) {
+        forget_settings(addr);
+        forget_settings(reply_from);
+    }
+}
+
+// A device that lost power comes back with the settings saved by us and
+// its position counter at zero; anything not saved is gone.
+void elliptec::power_cycled(const std::string &addr) {
+    if (!_quiet) {
+        std::cout << "device " << addr << " was power cycled, settings cache cleared" << std::endl;
+    }
+    forget_settings(addr);
+}
+
+void elliptec::refresh_settings(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::vector<std::string> addrs;
+    if (addr.empty()) {
+        for (const auto &[a, queries] : _settings) {
+            addrs.push_back(a);
+        }
+    } else {
+        addrs.push_back(addr);
+    }
+    for (const std::string &a : addrs) {
+        auto dev = _settings.find(a);
+        if (dev == _settings.end()) {
+            continue;
+        }
+        std::vector<std::pair<std::string, std::string>> queries;
+        for (const auto &[query, response] : dev->second) {
+            queries.emplace_back(query, response.substr(1,2));
+        }
+        _settings.erase(dev);
+        for (const auto &[query, reply] : queries) {
+            std::string response = cached_query(a, query, reply);
+            if (response.substr(1,2).compare(reply)) {
+                process_response(response);
+            }
+        }
+    }
+}
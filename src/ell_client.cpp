@@ -0,0 +1,128 @@
+#include "ell_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void write_all(int fd, const void *buf, size_t len) {
+    const char *p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("ell_client: write failed: ") + std::strerror(errno));
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static void read_all(int fd, void *buf, size_t len) {
+    char *p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = ::read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("ell_client: read failed: ") + std::strerror(errno));
+        }
+        if (n == 0) {
+            throw std::runtime_error("ell_client: daemon closed connection");
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+ell_client::ell_client(const std::string &socket_path) {
+    sockaddr_un sa{};
+    if (socket_path.length() >= sizeof(sa.sun_path)) {
+        throw std::invalid_argument("socket path too long: " + socket_path);
+    }
+    _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        throw std::runtime_error(std::string("ell_client: socket failed: ") + std::strerror(errno));
+    }
+    sa.sun_family = AF_UNIX;
+    std::strncpy(sa.sun_path, socket_path.c_str(), sizeof(sa.sun_path) - 1);
+    if (::connect(_fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+        int err = errno;
+        ::close(_fd);
+        _fd = -1;
+        throw std::runtime_error("ell_client: cannot connect to " + socket_path + ": " + std::strerror(err));
+    }
+}
+
+ell_client::~ell_client() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+ell_daemon_reply ell_client::transact(ell_daemon_op op, std::string addr, double value) {
+    if (addr.length() != 1) {
+        throw std::invalid_argument("address has to be a single hex digit");
+    }
+    ell_daemon_request req{};
+    req.op = op;
+    req.addr = addr[0];
+    req.value = value;
+    write_all(_fd, &req, sizeof(req));
+
+    ell_daemon_reply rep{};
+    read_all(_fd, &rep, sizeof(rep));
+    std::string msg(rep.msglen, '\0');
+    if (rep.msglen > 0) {
+        read_all(_fd, &msg[0], rep.msglen);
+    }
+    if (rep.result != RESULT_OK) {
+        throw std::runtime_error(msg);
+    }
+    return rep;
+}
+
+void ell_client::move_absolute(std::string addr, double pos) {
+    transact(OP_MOVE_ABSOLUTE, addr, pos);
+}
+
+void ell_client::move_relative(std::string addr, double pos) {
+    transact(OP_MOVE_RELATIVE, addr, pos);
+}
+
+void ell_client::home(std::string addr) {
+    transact(OP_HOME, addr);
+}
+
+void ell_client::stop(std::string addr) {
+    transact(OP_STOP, addr);
+}
+
+void ell_client::move_fwd(std::string addr) {
+    transact(OP_MOVE_FWD, addr);
+}
+
+void ell_client::move_bwd(std::string addr) {
+    transact(OP_MOVE_BWD, addr);
+}
+
+double ell_client::get_position(std::string addr) {
+    return transact(OP_GET_POSITION, addr).value;
+}
+
+uint8_t ell_client::get_status(std::string addr) {
+    return transact(OP_GET_STATUS, addr).code;
+}
+
+uint8_t ell_client::get_velocity(std::string addr) {
+    return uint8_t(transact(OP_GET_VELOCITY, addr).value);
+}
+
+void ell_client::set_velocity(std::string addr, uint8_t percent) {
+    transact(OP_SET_VELOCITY, addr, percent);
+}
@@ -0,0 +1,80 @@
+#ifndef ELL_CLIENT_H
+#define ELL_CLIENT_H
+
+/*! \file */
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Binary protocol between ell_daemon and ell_client over a unix domain
+ * stream socket. Every request is one fixed size ell_daemon_request; every
+ * reply is one ell_daemon_reply followed by msglen bytes of error text.
+ */
+static constexpr const char *ELL_DAEMON_SOCKET = "/tmp/ell_daemon.sock";
+
+enum ell_daemon_op : uint8_t {
+    OP_MOVE_ABSOLUTE = 1,   //value: position in deg/mm
+    OP_MOVE_RELATIVE = 2,   //value: distance in deg/mm
+    OP_HOME = 3,
+    OP_STOP = 4,
+    OP_MOVE_FWD = 5,
+    OP_MOVE_BWD = 6,
+    OP_GET_POSITION = 7,    //reply value: position in deg/mm
+    OP_GET_STATUS = 8,      //reply code: status, see ell_errors
+    OP_GET_VELOCITY = 9,    //reply value: percent
+    OP_SET_VELOCITY = 10    //value: percent
+};
+
+enum ell_daemon_result : uint8_t {
+    RESULT_OK = 0,
+    RESULT_ERROR = 1,       //message holds the error text
+    RESULT_BAD_REQUEST = 2
+};
+
+struct ell_daemon_request {
+    uint8_t op;             //ell_daemon_op
+    char addr;              //device address, '0'...'F'
+    uint8_t reserved[6];
+    double value;
+};
+
+struct ell_daemon_reply {
+    uint8_t result;         //ell_daemon_result
+    uint8_t code;           //device status code
+    uint16_t msglen;        //length of error text following the reply
+    uint8_t reserved[4];
+    double value;
+};
+
+static_assert(sizeof(ell_daemon_request) == 16, "ell_daemon_request layout changed");
+static_assert(sizeof(ell_daemon_reply) == 16, "ell_daemon_reply layout changed");
+
+/*
+ * Thin client for a running ell_daemon. Each call is one request/reply
+ * round trip; errors reported by the daemon are thrown as std::runtime_error.
+ */
+class ell_client {
+public:
+    explicit ell_client(const std::string &socket_path = ELL_DAEMON_SOCKET);
+    ~ell_client();
+    ell_client(const ell_client &) = delete;
+    ell_client &operator=(const ell_client &) = delete;
+
+    void move_absolute(std::string addr, double pos);
+    void move_relative(std::string addr, double pos);
+    void home(std::string addr);
+    void stop(std::string addr);
+    void move_fwd(std::string addr);
+    void move_bwd(std::string addr);
+    double get_position(std::string addr);
+    uint8_t get_status(std::string addr);
+    uint8_t get_velocity(std::string addr);
+    void set_velocity(std::string addr, uint8_t percent);
+
+private:
+    int _fd = -1;
+    ell_daemon_reply transact(ell_daemon_op op, std::string addr, double value = 0);
+};
+
+#endif // ELL_CLIENT_H
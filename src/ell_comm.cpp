@@ -7,25 +7,116 @@
  *****************************************/
 std::string elliptec::read()
 {
-    std::string response = bserial->readStringUntil("\r\n");
-    std::cout << "got response " << response << std::endl;
+    return read(bserial->deadline());
+}
+
+std::string elliptec::read(std::chrono::steady_clock::time_point deadline)
+{
+    if (_reader_running) {
+        return read_mailbox(deadline);
+    }
+    std::string response = bserial->read_frame(deadline);
+    while (route_stray(response)) {
+        response = bserial->read_frame(deadline);
+    }
+    if (!_background_io && !_quiet) {
+        std::cout << "got response " << response << std::endl;
+    }
     return response;
 }
 
-void elliptec::write(const std::string &data)
+// All replies received so far, at least one. Frames are views into the
+// transport's buffer and stay valid until the next read.
+size_t elliptec::read_frames(std::vector<std::string_view> &frames)
+{
+    if (_reader_running) {
+        return read_mailboxes(frames);
+    }
+    std::vector<std::string_view> batch;
+    if (bserial->next_frames(batch) == 0) {
+        return 0;
+    }
+    size_t n = 0;
+    for (std::string_view frame : batch) {
+        if (route_stray(frame)) {
+            continue;
+        }
+        if (!_background_io && !_quiet) {
+            std::cout << "got response " << frame << std::endl;
+        }
+        frames.push_back(frame);
+        ++n;
+    }
+    return n;
+}
+
+// reply_from: address the reply comes from if not the addressed device,
+// e.g. the new address after ca
+void elliptec::write(const std::string &data, const std::string &reply_from)
 {
-    bserial->writeString(data);
+    expect_reply_from(reply_from.empty() ? data.substr(0,1) : reply_from);
+    forget_written(data, reply_from);
+    if (!_background_io) {
+        auto now = std::chrono::steady_clock::now();
+        _last_activity = now;
+        _addr_activity[data.substr(0,1)] = now;
+    }
+    std::lock_guard<std::mutex> lock(_writemtx);
+    bserial->write_frame(data);
 }
 
 std::string elliptec::query(const std::string &data) {
-    bserial->writeString(data);
-    std::string response = bserial->readStringUntil("\r\n");
+    {
+        std::lock_guard<std::mutex> lock(_writemtx);
+        bserial->write_frame(data);
+    }
+    std::string response = bserial->next_frame();
     std::cout << "got response " << response << std::endl;
     return response;
 }
 
+// One command for ell_handle, with no device lookups on the way out.
+// \return data of the reply, which has to be of type reply
+std::string elliptec::handle_command(const std::string &addr, const std::string &frame, const std::string &reply, bool motion, bool needs_home) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    ell_response ret;
+    if (motion) {
+        motion_scope scope(*this, addr, needs_home);
+        motion_write(frame);
+        ret = motion_response();
+    } else {
+        write(frame);
+        ret = process_response();
+    }
+    if (!ret.type.compare("GS")) {
+        uint8_t code = std::stoi(ret.data.substr(0,2), nullptr, 16);
+        if (code != OK) {
+            throw std::runtime_error("command " + frame + " failed: " + err2string(code));
+        }
+    }
+    if (ret.type.compare(reply)) {
+        throw std::runtime_error("command " + frame + ": expected " + reply + ", got " + ret.type + ret.data);
+    }
+    return ret.data;
+}
+
+// Errors are still printed.
+void elliptec::set_quiet(bool quiet) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    _quiet = quiet;
+}
+
+bool elliptec::quiet() {
+    return _quiet;
+}
+
+std::unique_lock<std::recursive_mutex> elliptec::try_claim_bus() {
+    return std::unique_lock<std::recursive_mutex>(_busmtx, std::try_to_lock);
+}
+
 void elliptec::close()
 {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if (bserial->isOpen())
         bserial->close();
 }
@@ -36,13 +127,10 @@ bool elliptec::isopen()
 }
 
 void elliptec::open(std::string port) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
     if (!bserial->isOpen()) {
         try {
-             bserial->open(port, 9600,
-                           boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
-                           boost::asio::serial_port_base::character_size(8),
-                           boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none),
-                           boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one));
+             bserial->open(port, 9600);
          }  catch (std::exception & ex) {
              std::cout << ex.what() << std::endl;
          }
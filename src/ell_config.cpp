@@ -0,0 +1,208 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Configuration snapshot
+ *
+ *****************************************/
+std::string ell_config_to_string(const ell_config &cfg) {
+    std::stringstream ss;
+    for (const ell_device_config &dev : cfg.devices) {
+        ss << dev.serial << " " << dev.address;
+        if (dev.stage) {
+            ss << " " << unsigned(dev.velocity) << " " << dev.jog << " " << dev.home_offset;
+            for (const auto &motor : dev.period) {
+                ss << " " << motor[0] << " " << motor[1];
+            }
+        }
+        ss << "\n";
+    }
+    return ss.str();
+}
+
+ell_config ell_config_from_string(const std::string &text) {
+    ell_config cfg;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        std::istringstream ls(line);
+        ell_device_config dev;
+        if (!(ls >> dev.serial >> dev.address)) {
+            throw std::invalid_argument("bad config line: " + line);
+        }
+        unsigned velocity;
+        if (ls >> velocity) {
+            dev.stage = true;
+            dev.velocity = velocity;
+            ls >> dev.jog >> dev.home_offset;
+            for (auto &motor : dev.period) {
+                ls >> motor[0] >> motor[1];
+            }
+            if (!ls) {
+                throw std::invalid_argument("bad config line: " + line);
+            }
+        }
+        cfg.devices.push_back(dev);
+    }
+    return cfg;
+}
+
+// Settings as the device reports them; jog and home offset stay in steps so
+// that a restore compares exactly what it would write.
+ell_device_config elliptec::read_config(const ell_device &dev) {
+    const std::string &addr = dev.address;
+    ell_device_config cfg;
+    cfg.serial = dev.serial;
+    cfg.address = addr;
+    cfg.stage = devislinrot(addr);
+    if (!cfg.stage) {
+        return cfg;
+    }
+    cfg.velocity = uint8_t(hex2step(handle_command(addr, addr + "gv", "GV").substr(0,2)));
+    cfg.jog = hex2step(handle_command(addr, addr + "gj", "GJ"));
+    cfg.home_offset = hex2step(handle_command(addr, addr + "go", "HO"));
+    for (uint8_t m = 0; m < cfg.period.size(); ++m) {
+        std::string type = "I" + std::to_string(m + 1);
+        write(addr + "i" + std::to_string(m + 1));
+        std::string response = read();
+        if (response.substr(1,2).compare(type)) {
+            process_response(response);
+            throw std::runtime_error("motor info of " + addr + " failed: " + response);
+        }
+        ell_motor_info info = parse_motor_info(response);
+        cfg.period[m] = {info.period_fwd, info.period_bwd};
+    }
+    return cfg;
+}
+
+ell_config elliptec::snapshot_config() {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    quiet_scope quiet(*this);
+    ell_config cfg;
+    for (const ell_device &dev : devices) {
+        cfg.devices.push_back(read_config(dev));
+    }
+    return cfg;
+}
+
+// Moves every device of the snapshot back to its address. All moves are
+// checked before the first ca goes out, so an address held by a device
+// that stays fails with nothing written. Devices that swapped addresses
+// are moved through a free one.
+// \return serials of the devices moved
+std::vector<uint64_t> elliptec::restore_addresses(const ell_config &cfg, ell_restore_result &result) {
+    std::unordered_map<uint64_t, std::string> moves;    //serial to address wanted
+    std::vector<std::string> wanted;
+    for (const ell_device_config &want : cfg.devices) {
+        if (std::find(wanted.begin(), wanted.end(), want.address) != wanted.end()) {
+            throw std::runtime_error("snapshot has more than one device at address " + want.address);
+        }
+        wanted.push_back(want.address);
+        auto dev = std::find_if(devices.begin(), devices.end(), [&](const ell_device &d) { return d.serial == want.serial; });
+        if ((dev != devices.end()) && (dev->address != want.address)) {
+            moves[want.serial] = want.address;
+        }
+    }
+    auto holder = [&](const std::string &addr) {
+        return std::find_if(devices.begin(), devices.end(), [&](const ell_device &d) { return d.address == addr; });
+    };
+    for (const auto &[serial, addr] : moves) {
+        auto dev = holder(addr);
+        if ((dev != devices.end()) && !moves.count(dev->serial)) {
+            throw std::runtime_error("cannot move device " + std::to_string(serial) + " back to address " + addr + ", device " + std::to_string(dev->serial) + " is there");
+        }
+    }
+    std::string spare;
+    for (char c : std::string("0123456789ABCDEF")) {
+        std::string addr(1, c);
+        if ((holder(addr) == devices.end()) && (std::find(wanted.begin(), wanted.end(), addr) == wanted.end())) {
+            spare = addr;
+            break;
+        }
+    }
+
+    std::vector<uint64_t> moved;
+    std::unordered_map<uint64_t, std::string> left = moves;
+    while (!left.empty()) {
+        auto next = std::find_if(left.begin(), left.end(), [&](const auto &m) { return holder(m.second) == devices.end(); });
+        if (next == left.end()) {
+            //every target is held by a device still to move: a cycle
+            if (spare.empty()) {
+                throw std::runtime_error("no free address to swap devices through");
+            }
+            next = left.begin();
+            auto dev = holder(next->second);
+            if (!readdress(dev->address, spare)) {
+                throw std::runtime_error("cannot move device " + std::to_string(dev->serial) + " to free address " + spare);
+            }
+            ++result.writes;
+            continue;
+        }
+        auto dev = std::find_if(devices.begin(), devices.end(), [&](const ell_device &d) { return d.serial == next->first; });
+        if (!readdress(dev->address, next->second)) {
+            throw std::runtime_error("cannot move device " + std::to_string(next->first) + " back to address " + next->second);
+        }
+        ++result.writes;
+        moved.push_back(next->first);
+        left.erase(next);
+    }
+    return moved;
+}
+
+// Devices are found by serial number and moved back to their address
+// first. Each setting is compared with what the device reports and only
+// the differing ones are written; us follows only if anything was written,
+// so restoring an unchanged rig costs the queries and no EEPROM writes.
+ell_restore_result elliptec::restore_config(const ell_config &cfg) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    quiet_scope quiet(*this);
+    ell_restore_result result;
+    std::vector<uint64_t> moved = restore_addresses(cfg, result);
+    for (const ell_device_config &want : cfg.devices) {
+        auto dev = std::find_if(devices.begin(), devices.end(), [&](const ell_device &d) { return d.serial == want.serial; });
+        if (dev == devices.end()) {
+            result.missing.push_back(want.serial);
+            continue;
+        }
+        bool changed = std::find(moved.begin(), moved.end(), want.serial) != moved.end();
+        const std::string &addr = want.address;
+        auto set = [&](const std::string &cmd) {
+            handle_command(addr, addr + cmd, "GS");
+            ++result.writes;
+            changed = true;
+        };
+        if (want.stage && devislinrot(addr)) {
+            ell_device_config now = read_config(*dev);
+            if (now.velocity != want.velocity) {
+                set("sv" + uc2hex(want.velocity));
+                cache_setting(addr, "gv", "GV" + uc2hex(want.velocity));
+            }
+            if (now.jog != want.jog) {
+                set("sj" + step2hex(want.jog));
+                cache_setting(addr, "gj", "GJ" + step2hex(want.jog));
+            }
+            if (now.home_offset != want.home_offset) {
+                set("so" + step2hex(want.home_offset));
+                cache_setting(addr, "go", "HO" + step2hex(want.home_offset));
+            }
+            for (uint8_t m = 0; m < want.period.size(); ++m) {
+                std::string motor = std::to_string(m + 1);
+                if (now.period[m][0] != want.period[m][0]) {
+                    set("f" + motor + us2hex(0x8000 | want.period[m][0]));
+                }
+                if (now.period[m][1] != want.period[m][1]) {
+                    set("b" + motor + us2hex(0x8000 | want.period[m][1]));
+                }
+            }
+        }
+        if (changed) {
+            save_userdata(addr);
+            ++result.writes;
+            result.saved.push_back(addr);
+        }
+    }
+    return result;
+}
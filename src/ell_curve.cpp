@@ -0,0 +1,183 @@
+#include "ell.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*****************************************
+ *
+ * Current curve store
+ *
+ *****************************************/
+static const char ELL_CURVE_MAGIC[8] = {'E', 'L', 'L', 'C', 'U', 'R', 'V', 'E'};
+static constexpr uint32_t ELL_CURVE_VERSION = 1;
+
+// Each point is 6 decimal digits: 2 period, 4 current.
+bool ell_curve_decode(std::string_view payload, uint8_t *period, uint16_t *current) {
+    if (payload.length() < 6*ELL_CURVE_POINTS) {
+        return false;
+    }
+    const char *p = payload.data();
+    for (size_t i=0; i<ELL_CURVE_POINTS; ++i, p+=6) {
+        unsigned d[6];
+        for (size_t k=0; k<6; ++k) {
+            d[k] = unsigned(p[k]) - '0';
+            if (d[k] > 9) {
+                return false;
+            }
+        }
+        period[i] = 10*d[0] + d[1];
+        current[i] = 1000*d[2] + 100*d[3] + 10*d[4] + d[5];
+    }
+    return true;
+}
+
+static void check_header(const ell_curve_header &hdr, const std::string &path) {
+    if (std::memcmp(hdr.magic, ELL_CURVE_MAGIC, sizeof(hdr.magic))) {
+        throw std::runtime_error(path + " is not a current curve file");
+    }
+    if ((hdr.version != ELL_CURVE_VERSION) || (hdr.record_size != sizeof(ell_curve_record)) || (hdr.points != ELL_CURVE_POINTS)) {
+        throw std::runtime_error(path + " has unsupported curve format version " + std::to_string(hdr.version));
+    }
+}
+
+ell_curve_writer::ell_curve_writer(const std::string &path) : _path(path) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(_path, ec);
+    if (ec || (size == 0)) {
+        ell_curve_header hdr{};
+        std::memcpy(hdr.magic, ELL_CURVE_MAGIC, sizeof(hdr.magic));
+        hdr.version = ELL_CURVE_VERSION;
+        hdr.record_size = sizeof(ell_curve_record);
+        hdr.points = ELL_CURVE_POINTS;
+        std::ofstream out(_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        if (!out) {
+            throw std::runtime_error("cannot write " + _path);
+        }
+    } else {
+        ell_curve_header hdr{};
+        std::ifstream in(_path, std::ios::binary);
+        in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+        if (!in) {
+            throw std::runtime_error("cannot read header of " + _path);
+        }
+        check_header(hdr, _path);
+    }
+}
+
+void ell_curve_writer::append(const ell_curve_record &rec) {
+    append(std::vector<ell_curve_record>{rec});
+}
+
+void ell_curve_writer::append(const std::vector<ell_curve_record> &recs) {
+    std::ofstream out(_path, std::ios::binary | std::ios::app);
+    out.write(reinterpret_cast<const char*>(recs.data()), recs.size()*sizeof(ell_curve_record));
+    if (!out) {
+        throw std::runtime_error("cannot append to " + _path);
+    }
+}
+
+ell_curve_file::ell_curve_file(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (size_t(st.st_size) < sizeof(ell_curve_header))) {
+        ::close(fd);
+        throw std::runtime_error(path + " is not a current curve file");
+    }
+    _maplen = st.st_size;
+    _map = mmap(nullptr, _maplen, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (_map == MAP_FAILED) {
+        _map = nullptr;
+        throw std::runtime_error("cannot map " + path);
+    }
+    try {
+        check_header(*static_cast<const ell_curve_header*>(_map), path);
+    } catch (...) {
+        munmap(_map, _maplen);
+        throw;
+    }
+    // a partially written trailing record is ignored
+    _records = reinterpret_cast<const ell_curve_record*>(static_cast<const char*>(_map) + sizeof(ell_curve_header));
+    _count = (_maplen - sizeof(ell_curve_header)) / sizeof(ell_curve_record);
+}
+
+ell_curve_file::~ell_curve_file() {
+    if (_map) {
+        munmap(_map, _maplen);
+    }
+}
+
+size_t ell_curve_file::size() const {
+    return _count;
+}
+
+std::span<const ell_curve_record> ell_curve_file::records() const {
+    return std::span<const ell_curve_record>(_records, _count);
+}
+
+std::vector<const ell_curve_record*> ell_curve_file::select(uint64_t serial, uint8_t motor) const {
+    std::vector<const ell_curve_record*> sel;
+    for (const ell_curve_record &rec : records()) {
+        if ((rec.serial == serial) && (rec.motor == motor)) {
+            sel.push_back(&rec);
+        }
+    }
+    return sel;
+}
+
+/*****************************************
+ *
+ * Capture
+ *
+ *****************************************/
+// Reads the current curve of every motor of every given device and appends
+// them to the file at path. With scan, the curves are measured first on all
+// devices concurrently. Returns the number of records written.
+size_t elliptec::capture_current_curves(std::string path, std::vector<std::string> addrs, bool scan) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    if (addrs.empty()) {
+        addrs = mids;
+    }
+    ell_curve_writer writer(path);
+
+    if (scan) {
+        for (const ell_maint_result &res : run_maintenance(MAINT_SCAN_CURRENT, addrs)) {
+            if (!res.completed) {
+                std::cout << "current curve scan on " << res.address << " failed: " << err2string(res.status) << std::endl;
+            }
+        }
+    }
+
+    std::vector<ell_curve_record> recs;
+    for (const std::string &addr : addrs) {
+        auto dev = devinfo_at_addr(addr);
+        if (!dev.has_value()) {
+            throw std::runtime_error("Device with address " + addr + " not in connected device list");
+        }
+        uint8_t nmotors = 0;
+        if (devintype("linrot", dev.value().type)) {
+            nmotors = 2;
+        } else if (devintype("indexed", dev.value().type)) {
+            nmotors = 1;
+        }
+        for (uint8_t m = 1; m <= nmotors; ++m) {
+            ell_curve_record rec{};
+            if (read_motor_current_curve(addr, m, rec)) {
+                rec.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                rec.serial = dev.value().serial;
+                recs.push_back(rec);
+            }
+        }
+    }
+    writer.append(recs);
+    return recs.size();
+}
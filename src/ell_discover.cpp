@@ -0,0 +1,65 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Bus discovery
+ *
+ *****************************************/
+// Probes run back to back, one address at a time: devices share the
+// return line, so two replies must never overlap. On transports that see
+// a reply start, a missing device is given up on as soon as the first
+// reply byte is overdue, and a present one
+// gets its next probe written while the tail of its reply is still on
+// the wire, timed to complete just as that reply ends.
+std::vector<ell_device> elliptec::scan_bus() {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    using std::chrono::steady_clock;
+    auto chars = [](size_t n) {
+        return std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(n*CHAR_TIME));
+    };
+    const auto probe_time = chars(SCAN_PROBE_CHARS);
+    const auto reply_time = chars(SCAN_REPLY_CHARS);
+    const auto margin = std::chrono::milliseconds(SCAN_MARGIN_MS);
+    // With the reader thread running, replies can only be taken from the
+    // mailbox of the address last written to. Without rx start detection
+    // the reply's timing is unknown, so each probe waits for the whole
+    // reply, or for its deadline, before the next goes out.
+    const bool pipeline = !_reader_running && bserial->detects_rx_start();
+
+    std::vector<ell_device> found;
+    auto sent = steady_clock::now();
+    write(int2addr(0) + "in");
+    for (uint8_t id = 0; id < 16; ++id) {
+        std::string next = (id < 15) ? int2addr(id + 1) + "in" : "";
+        std::string response;
+        bool started = !pipeline || bserial->rx_started(sent + probe_time + margin);
+        if (started) {
+            auto first = pipeline ? steady_clock::now() : sent + probe_time;
+            if (pipeline && !next.empty()) {
+                std::this_thread::sleep_until(first + reply_time - probe_time);
+                write(next);
+                sent = steady_clock::now();
+                next = "";
+            }
+            try {
+                response = read(first + reply_time + margin);
+            } catch (timeout_exception &) {
+            }
+        }
+        if (!next.empty()) {
+            write(next);
+            sent = steady_clock::now();
+        }
+        if (response.empty() || response.substr(1,2).compare("IN")) {
+            continue;
+        }
+        try {
+            ell_device dev = parse_devinfo(response);
+            handle_devinfo(dev);
+            found.push_back(dev);
+        } catch (std::exception &ex) {
+            std::cout << "scan: " << ex.what() << std::endl;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,195 @@
+#include "ell_emulator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+/*****************************************
+ *
+ * Emulated bus
+ *
+ *****************************************/
+
+// data characters following the two command letters, 0 if not listed
+static size_t datalen(const std::string &cmd) {
+    static const std::map<std::string, size_t> len = {
+        {"ma", 8}, {"mr", 8}, {"so", 8}, {"sj", 8}, {"sv", 2}, {"ga", 1}, {"ca", 1}, {"ho", 1},
+        {"is", 2}, {"f1", 4}, {"f2", 4}, {"b1", 4}, {"b2", 4}, {"e1", 4},
+        {"a1", 4}, {"a2", 4}, {"a3", 4}, {"r1", 4}, {"r2", 4}, {"r3", 4},
+        {"t1", 4}, {"t2", 4}, {"t3", 4}};
+    auto it = len.find(cmd);
+    return (it == len.end()) ? 0 : it->second;
+}
+
+static std::string hex(int64_t value, int width) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llX", static_cast<unsigned long long>(value));
+    return std::string(buf + 16 - width);
+}
+
+static int64_t signed_hex(const std::string &data) {
+    int64_t v = std::stoll(data, nullptr, 16);
+    if (v >= (int64_t(1) << 31)) {
+        v -= int64_t(1) << 32;
+    }
+    return v;
+}
+
+ell_emulator::ell_emulator(const std::string &spec) {
+    std::string s = spec;
+    for (char &c : s) {
+        if (c == ',') {
+            c = ' ';
+        }
+    }
+    std::istringstream in(s);
+    std::string item;
+    while (in >> item) {
+        size_t colon = item.find(':');
+        if ((colon != 1) || !std::isxdigit(static_cast<unsigned char>(item[0]))) {
+            throw std::invalid_argument("emulated device has to be address:type, got " + item);
+        }
+        device dev;
+        dev.address = std::string(1, std::toupper(static_cast<unsigned char>(item[0])));
+        dev.type = std::stoi(item.substr(2));
+        switch (dev.type) {
+            case 14: dev.pulses = 143360; break;
+            case 18: dev.pulses = 262144; break;
+            case 8: dev.pulses = 262144; break;
+            case 17: case 20: dev.pulses = 1024; break;
+            default: dev.pulses = 1000;
+        }
+        dev.jog = dev.pulses / 36;
+        _devices[dev.address] = dev;
+    }
+    if (_devices.empty()) {
+        throw std::invalid_argument("no emulated devices in " + spec);
+    }
+}
+
+uint64_t ell_emulator::commands() const {
+    return _commands;
+}
+
+void ell_emulator::feed(std::string_view bytes, std::deque<std::string> &replies) {
+    _buf.append(bytes);
+    while (_buf.length() >= 3) {
+        std::string cmd = _buf.substr(1, 2);
+        size_t n = 3 + datalen(cmd);
+        // "ho" takes an optional direction digit
+        if (!cmd.compare("ho") && ((_buf.length() < 4) || !std::isdigit(static_cast<unsigned char>(_buf[3])))) {
+            n = 3;
+        }
+        if (_buf.length() < n) {
+            break;
+        }
+        handle(_buf.substr(0, n), replies);
+        _buf.erase(0, n);
+    }
+}
+
+void ell_emulator::handle(const std::string &msg, std::deque<std::string> &replies) {
+    ++_commands;
+    std::string addr = msg.substr(0, 1);
+    std::string cmd = msg.substr(1, 2);
+    std::string data = msg.substr(3);
+
+    std::vector<device*> targets;
+    for (auto &[a, dev] : _devices) {
+        if (!a.compare(addr) || !dev.group.compare(addr)) {
+            targets.push_back(&dev);
+        }
+    }
+    for (device *dev : targets) {
+        std::string from = dev->group.compare(addr) ? dev->address : addr;
+        auto reply = [&](const std::string &s) { replies.push_back(from + s); };
+        if (!cmd.compare("in")) {
+            char serial[9];
+            std::snprintf(serial, sizeof(serial), "%08d", 12345600 + std::stoi(dev->address, nullptr, 16));
+            reply("IN" + hex(dev->type, 2) + serial + "202317010168" + hex(dev->pulses, 8));
+        } else if (!cmd.compare("gs")) {
+            reply("GS00");
+        } else if (!cmd.compare("gp")) {
+            reply("PO" + hex(dev->position, 8));
+        } else if (!cmd.compare("ma") || !cmd.compare("mr") || !cmd.compare("ho") || !cmd.compare("fw") || !cmd.compare("bw")) {
+            if (!cmd.compare("ma")) {
+                dev->position = signed_hex(data);
+            } else if (!cmd.compare("mr")) {
+                dev->position += signed_hex(data);
+            } else if (!cmd.compare("ho")) {
+                dev->position = 0;
+            } else if (!cmd.compare("fw")) {
+                dev->position += dev->jog;
+            } else {
+                dev->position -= dev->jog;
+            }
+            dev->group = "";
+            reply("PO" + hex(dev->position, 8));
+        } else if (!cmd.compare("ms")) {
+            reply("PO" + hex(dev->position, 8));
+        } else if (!cmd.compare("gj")) {
+            reply("GJ" + hex(dev->jog, 8));
+        } else if (!cmd.compare("sj")) {
+            dev->jog = signed_hex(data);
+            reply("GS00");
+        } else if (!cmd.compare("gv")) {
+            reply("GV" + hex(dev->velocity, 2));
+        } else if (!cmd.compare("sv")) {
+            dev->velocity = std::stoi(data, nullptr, 16);
+            reply("GS00");
+        } else if (!cmd.compare("go")) {
+            reply("HO" + hex(dev->home_offset, 8));
+        } else if (!cmd.compare("so")) {
+            dev->home_offset = signed_hex(data);
+            reply("GS00");
+        } else if (!cmd.compare("ga")) {
+            dev->group = data;
+            replies.push_back(data + "GS00");
+        } else if (!cmd.compare("ca")) {
+            device moved = *dev;
+            moved.address = std::string(1, std::toupper(static_cast<unsigned char>(data[0])));
+            replies.push_back(moved.address + "GS00");
+            _devices.erase(dev->address);
+            _devices[moved.address] = moved;
+            return;
+        } else if (!cmd.compare("i1") || !cmd.compare("i2")) {
+            const auto &period = dev->period.at(cmd[1] - '1');
+            reply(std::string("I") + cmd[1] + "01" + "0100" + "FFFFFFFF" + hex(period[0], 4) + hex(period[1], 4));
+        } else if (!cmd.compare("f1") || !cmd.compare("f2") || !cmd.compare("b1") || !cmd.compare("b2")) {
+            dev->period.at(cmd[1] - '1').at(cmd[0] == 'b') = std::stoi(data, nullptr, 16) & 0x7FFF;
+            reply("GS00");
+        } else if (!cmd.compare("C1") || !cmd.compare("C2")) {
+            std::string points;
+            for (int i = 0; i < 87; ++i) {
+                char pt[7];
+                std::snprintf(pt, sizeof(pt), "%02d%04d", i % 100, 1000 + i);
+                points += pt;
+            }
+            reply(cmd + points);
+        } else if ((cmd[0] == 'a') || (cmd[0] == 'r') || (cmd[0] == 't')) {
+            int64_t &pos = dev->paddle.at(cmd[1] - '1');
+            int64_t value = std::stoll(data, nullptr, 16);
+            if (cmd[0] == 'a') {
+                pos = value;
+            } else if (cmd[0] == 'r') {
+                pos += (value >= 0x8000) ? value - 0x10000 : value;
+            } else {
+                // drive time in ms, bit 15 drives forward
+                int64_t steps = (value & 0x7FFF) / PADDLE_MS_PER_STEP;
+                pos += (value & 0x8000) ? steps : -steps;
+            }
+            pos = std::clamp<int64_t>(pos, 0, PADDLE_STEPS);
+            reply(std::string("P") + cmd[1] + hex(pos, 4));
+        } else if (!cmd.compare("is")) {
+        } else if (!cmd.compare("om") || !cmd.compare("cm") || !cmd.compare("st") || !cmd.compare("us")
+                   || !cmd.compare("s1") || !cmd.compare("s2") || !cmd.compare("c1") || !cmd.compare("c2")
+                   || !cmd.compare("e1") || !cmd.compare("h1")) {
+            reply("GS00");
+        } else {
+            reply("GS03");
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ELL_EMULATOR_H
+#define ELL_EMULATOR_H
+
+/*! \file */
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+
+/*
+ * Elliptec bus with emulated devices, for loopback_transport. Commands are
+ * answered immediately: motions complete at once and report PO, maintenance
+ * commands report GS 0. Enough of the protocol is covered to construct an
+ * elliptec and drive every public method.
+ */
+class ell_emulator {
+public:
+    /**
+     * \param spec emulated devices as address:type pairs separated by
+     * spaces or commas, e.g. "0:14 3:17". Addresses are hex digits.
+     */
+    explicit ell_emulator(const std::string &spec);
+
+    /**
+     * Parse bytes written to the bus and append the reply frames, without
+     * terminator. Incomplete commands are kept for the next call.
+     */
+    void feed(std::string_view bytes, std::deque<std::string> &replies);
+
+    /**
+     * \return number of commands handled
+     */
+    uint64_t commands() const;
+
+private:
+    struct device {
+        std::string address;
+        uint8_t type = 0;
+        uint32_t pulses = 0;        //per rev or mm
+        int64_t position = 0;       //steps
+        int64_t jog = 0;            //steps
+        int64_t home_offset = 0;    //steps
+        uint8_t velocity = 100;     //percent
+        std::array<std::array<uint16_t, 2>, 2> period = {{{0x6000, 0x6000}, {0x6200, 0x6200}}};   //motor 1 and 2 fwd and bwd
+        std::string group = "";     //group address of the next motion
+        std::array<int64_t, 3> paddle = {0, 0, 0};  //paddle positions in steps, MPC320
+    };
+
+    static constexpr int64_t PADDLE_STEPS = 515;    //paddle travel, 170 deg
+    static constexpr int64_t PADDLE_MS_PER_STEP = 2; //paddle drive speed
+
+    std::map<std::string, device> _devices;
+    std::string _buf;
+    uint64_t _commands = 0;
+
+    void handle(const std::string &cmd, std::deque<std::string> &replies);
+};
+
+#endif // ELL_EMULATOR_H
@@ -0,0 +1,122 @@
+#ifndef ELL_EXPECTED_H
+#define ELL_EXPECTED_H
+
+/*! \file */
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <version>
+
+enum ell_error_kind {
+    ERR_DEVICE = 0,     //device replied with a status other than OK, see code
+    ERR_TIMEOUT = 1,    //no reply in time
+    ERR_PARSE = 2,      //reply could not be understood
+    ERR_INVALID = 3,    //bad argument or unsupported device, nothing was sent
+    ERR_MISSED = 4      //motion ended outside DEGERR/MMERR of the target
+};
+
+struct ell_error {
+    ell_error_kind kind = ERR_DEVICE;
+    uint8_t code = 0;           //ell_errors code for ERR_DEVICE
+    std::string address;        //address of device on controller
+    std::string message;
+};
+
+/*
+ * Result of the try_ methods of elliptec: a value or an ell_error. This is
+ * std::expected<T, ell_error> where the standard library has it, and a
+ * bundled subset of it otherwise: has_value(), operator bool, value(),
+ * error(), value_or(), operator* and operator->.
+ */
+#if defined(__cpp_lib_expected) && (__cpp_lib_expected >= 202202L)
+
+#include <expected>
+
+template <class T>
+using ell_expected = std::expected<T, ell_error>;
+using ell_unexpected = std::unexpected<ell_error>;
+
+#else
+
+class ell_unexpected {
+public:
+    explicit ell_unexpected(ell_error e) : _error(std::move(e)) {}
+    const ell_error &error() const & { return _error; }
+    ell_error &&error() && { return std::move(_error); }
+
+private:
+    ell_error _error;
+};
+
+// thrown by value() on an error
+class ell_bad_expected_access : public std::runtime_error {
+public:
+    explicit ell_bad_expected_access(const ell_error &e) : std::runtime_error(e.message), _error(e) {}
+    const ell_error &error() const { return _error; }
+
+private:
+    ell_error _error;
+};
+
+template <class T>
+class ell_expected {
+public:
+    ell_expected() : _v(std::in_place_index<0>) {}
+    ell_expected(const T &value) : _v(std::in_place_index<0>, value) {}
+    ell_expected(T &&value) : _v(std::in_place_index<0>, std::move(value)) {}
+    ell_expected(ell_unexpected e) : _v(std::in_place_index<1>, std::move(e).error()) {}
+
+    bool has_value() const { return _v.index() == 0; }
+    explicit operator bool() const { return has_value(); }
+
+    T &value() & { check(); return std::get<0>(_v); }
+    const T &value() const & { check(); return std::get<0>(_v); }
+    T &&value() && { check(); return std::get<0>(std::move(_v)); }
+    template <class U>
+    T value_or(U &&other) const & { return has_value() ? std::get<0>(_v) : static_cast<T>(std::forward<U>(other)); }
+
+    const ell_error &error() const { return std::get<1>(_v); }
+
+    T &operator*() { return std::get<0>(_v); }
+    const T &operator*() const { return std::get<0>(_v); }
+    T *operator->() { return &std::get<0>(_v); }
+    const T *operator->() const { return &std::get<0>(_v); }
+
+private:
+    std::variant<T, ell_error> _v;
+
+    void check() const {
+        if (!has_value()) {
+            throw ell_bad_expected_access(error());
+        }
+    }
+};
+
+template <>
+class ell_expected<void> {
+public:
+    ell_expected() = default;
+    ell_expected(ell_unexpected e) : _error(std::move(e).error()) {}
+
+    bool has_value() const { return !_error.has_value(); }
+    explicit operator bool() const { return has_value(); }
+
+    void value() const {
+        if (_error.has_value()) {
+            throw ell_bad_expected_access(*_error);
+        }
+    }
+
+    const ell_error &error() const { return *_error; }
+
+private:
+    std::optional<ell_error> _error;
+};
+
+#endif
+
+#endif // ELL_EXPECTED_H
@@ -0,0 +1,57 @@
+#include "ell_frame_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::span<char> ell_frame_ring::prepare() {
+    if (_head > 0) {
+        size_t n = _tail - _head;
+        std::memmove(_buf.data(), _buf.data() + _head, n);
+        _scan -= _head;
+        _head = 0;
+        _tail = n;
+    }
+    if (_tail == CAPACITY) {
+        clear();
+    }
+    return std::span<char>(_buf.data() + _tail, CAPACITY - _tail);
+}
+
+void ell_frame_ring::commit(size_t n) {
+    _tail += n;
+}
+
+bool ell_frame_ring::next(std::string_view &frame) {
+    // the terminator may straddle the previous scan end, so back up one
+    size_t from = std::max(_scan, _head + 1) - 1;
+    for (size_t i = from; i + 1 < _tail; ++i) {
+        if ((_buf[i] == '\r') && (_buf[i+1] == '\n')) {
+            frame = std::string_view(_buf.data() + _head, i - _head);
+            _head = i + 2;
+            _scan = _head;
+            return true;
+        }
+    }
+    _scan = _tail;
+    return false;
+}
+
+size_t ell_frame_ring::drain(std::vector<std::string_view> &frames) {
+    size_t n = 0;
+    std::string_view frame;
+    while (next(frame)) {
+        frames.push_back(frame);
+        ++n;
+    }
+    return n;
+}
+
+void ell_frame_ring::clear() {
+    _head = 0;
+    _tail = 0;
+    _scan = 0;
+}
+
+size_t ell_frame_ring::pending() const {
+    return _tail - _head;
+}
@@ -0,0 +1,65 @@
+#ifndef ELL_FRAME_RING_H
+#define ELL_FRAME_RING_H
+
+/*! \file */
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/*
+ * Fixed receive buffer that splits "\r\n" terminated frames in place.
+ *
+ * Bytes are read straight into prepare() and frames are handed out as
+ * views into the buffer, so nothing is allocated or copied per frame. Data
+ * never wraps around: prepare() moves the unconsumed tail to the front
+ * instead, which keeps every frame contiguous. Views stay valid until the
+ * next prepare() or clear().
+ */
+class ell_frame_ring {
+public:
+    static constexpr size_t CAPACITY = 4096;    //a C1 curve, the longest reply, is 527 bytes
+
+    /**
+     * Contiguous free space to receive into. Discards unconsumed bytes if
+     * the buffer is full without holding a complete frame.
+     */
+    std::span<char> prepare();
+
+    /**
+     * Mark n bytes of the prepare() span as received.
+     */
+    void commit(size_t n);
+
+    /**
+     * Pop the next complete frame, without terminator.
+     * \return false if no complete frame is buffered
+     */
+    bool next(std::string_view &frame);
+
+    /**
+     * Pop every complete frame and append it to frames.
+     * \return number of frames appended
+     */
+    size_t drain(std::vector<std::string_view> &frames);
+
+    /**
+     * Drop everything buffered.
+     */
+    void clear();
+
+    /**
+     * \return bytes received but not yet returned as a frame
+     */
+    size_t pending() const;
+
+private:
+    std::array<char, CAPACITY> _buf;
+    size_t _head = 0;       //start of the first unconsumed byte
+    size_t _tail = 0;       //end of received data
+    size_t _scan = 0;       //bytes before this position hold no terminator
+};
+
+#endif // ELL_FRAME_RING_H
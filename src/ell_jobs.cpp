@@ -0,0 +1,251 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Background jobs
+ *
+ *****************************************/
+uint32_t elliptec::add_background_job(std::string addr, ell_maint_op op, std::chrono::seconds idle) {
+    std::vector<std::string> steps = maint_steps(addr, op);
+    if (steps.empty()) {
+        throw std::invalid_argument("Device with address " + addr + " does not support this maintenance operation");
+    }
+
+    ell_job job;
+    job.info.address = addr;
+    job.info.op = op;
+    job.info.idle = idle;
+    job.steps = steps;
+    {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        job.info.id = _next_job_id++;
+        _jobs.push_back(job);
+        if (!_jobthread.joinable()) {
+            _jobthread = std::thread(&elliptec::job_loop, this);
+        }
+    }
+    _jobcv.notify_all();
+    return job.info.id;
+}
+
+void elliptec::remove_background_job(uint32_t id) {
+    std::lock_guard<std::recursive_mutex> bus(_busmtx);
+    std::string addr = "";
+    {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        for (auto it = _jobs.begin(); it != _jobs.end(); ++it) {
+            if (it->info.id == id) {
+                if (it->info.state == JOB_RUNNING) {
+                    addr = it->info.address;
+                }
+                _jobs.erase(it);
+                break;
+            }
+        }
+    }
+    if (addr != "") {
+        write(addr + "st");
+        try {
+            read();
+        } catch (timeout_exception &) {
+        }
+    }
+}
+
+std::vector<ell_job_info> elliptec::background_jobs() {
+    std::lock_guard<std::mutex> lock(_jobmtx);
+    std::vector<ell_job_info> infos;
+    infos.reserve(_jobs.size());
+    for (const ell_job &job : _jobs) {
+        infos.push_back(job.info);
+    }
+    return infos;
+}
+
+elliptec::motion_scope::motion_scope(elliptec &ell, const std::string &addr, bool needs_home) : _ell(ell) {
+    _ell.preempt_jobs(addr);
+    if (needs_home) {
+        _ell.ensure_homed(addr);
+    }
+}
+
+elliptec::motion_scope::~motion_scope() {
+    _ell._last_motion = std::chrono::steady_clock::now();
+}
+
+// Called with the bus held, before any motion command is written.
+void elliptec::preempt_jobs(std::string addr) {
+    bool running = false;
+    {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        for (ell_job &job : _jobs) {
+            if ((job.info.address == addr) && (job.info.state == JOB_RUNNING)) {
+                job.info.state = JOB_INTERRUPTED;
+                ++job.info.interruptions;
+                job.quiet_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(MAINT_DRAIN_MS);
+                running = true;
+            }
+        }
+    }
+    if (running) {
+        write(addr + "st");
+        try {
+            read();
+        } catch (timeout_exception &) {
+        }
+    }
+}
+
+void elliptec::job_status(ell_job &job, uint8_t code) {
+    if (code == BUSY) {
+        return;
+    }
+    job.info.status = code;
+    job.quiet_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(MAINT_DRAIN_MS);
+    if (code != OK) {
+        job.info.state = JOB_FAILED;
+    } else if (++job.step < job.steps.size()) {
+        // next step waits for its own idle window
+        job.info.state = JOB_WAITING;
+    } else {
+        job.info.state = JOB_DONE;
+    }
+}
+
+// A status frame from a device with a running job can arrive while another
+// device is being talked to (the job's completion reply). Hand it to the job
+// instead of returning it to the reader.
+bool elliptec::route_stray(std::string_view response) {
+    if (route_stop_reply(response)) {
+        return true;
+    }
+    if ((response.length() < 5) || response.substr(1,2).compare("GS")) {
+        return false;
+    }
+    if (!response.substr(0,1).compare(_expect_addr)) {
+        return false;
+    }
+    return route_job_status(response);
+}
+
+// Hands a GS frame to a background job on its device. Also swallows late
+// replies of a job that was just preempted.
+bool elliptec::route_job_status(std::string_view response) {
+    if ((response.length() < 5) || response.substr(1,2).compare("GS")) {
+        return false;
+    }
+    std::string addr(response.substr(0,1));
+    std::lock_guard<std::mutex> lock(_jobmtx);
+    for (ell_job &job : _jobs) {
+        if (job.info.address != addr) {
+            continue;
+        }
+        if (job.info.state == JOB_RUNNING) {
+            job_status(job, parsestatus(std::string(response)));
+            return true;
+        }
+        if (std::chrono::steady_clock::now() < job.quiet_until) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void elliptec::job_loop() {
+    const auto tick = std::chrono::milliseconds(2*MAINT_READ_MS);
+    while (true) {
+        std::vector<uint32_t> ids;
+        {
+            std::unique_lock<std::mutex> lock(_jobmtx);
+            _jobcv.wait_for(lock, tick, [this] { return _jobs_stop; });
+            if (_jobs_stop) {
+                return;
+            }
+            for (const ell_job &job : _jobs) {
+                if ((job.info.state != JOB_DONE) && (job.info.state != JOB_FAILED)) {
+                    ids.push_back(job.info.id);
+                }
+            }
+        }
+        for (uint32_t id : ids) {
+            // somebody else holding the bus means it is not idle
+            std::unique_lock<std::recursive_mutex> bus(_busmtx, std::try_to_lock);
+            if (!bus.owns_lock()) {
+                break;
+            }
+            job_step(id);
+        }
+    }
+}
+
+// Called with the bus held. Starts the job's current step once bus and
+// device have been idle long enough, or polls gs while it is running.
+void elliptec::job_step(uint32_t id) {
+    auto now = std::chrono::steady_clock::now();
+    std::string addr;
+    std::string cmd;
+    {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        auto it = std::find_if(_jobs.begin(), _jobs.end(), [id](const ell_job &j) { return j.info.id == id; });
+        if (it == _jobs.end()) {
+            return;
+        }
+        ell_job &job = *it;
+        addr = job.info.address;
+        if (job.info.state == JOB_RUNNING) {
+            if (now - job.last_poll < std::chrono::milliseconds(MAINT_POLL_MS)) {
+                return;
+            }
+            cmd = "gs";
+        } else if ((job.info.state == JOB_WAITING) || (job.info.state == JOB_INTERRUPTED)) {
+            for (const ell_job &other : _jobs) {
+                if ((other.info.address == addr) && (other.info.state == JOB_RUNNING)) {
+                    return;
+                }
+            }
+            auto dev_activity = _addr_activity.find(addr);
+            if ((now < job.quiet_until) || (now - _last_activity < job.info.idle)) {
+                return;
+            }
+            if ((dev_activity != _addr_activity.end()) && (now - dev_activity->second < job.info.idle)) {
+                return;
+            }
+            job.info.state = JOB_RUNNING;
+            cmd = job.steps.at(job.step);
+        } else {
+            return;
+        }
+        job.last_poll = now;
+    }
+
+    std::string response = "";
+    _background_io = true;
+    bserial->setTimeout(boost::posix_time::milliseconds(MAINT_POLL_MS));
+    try {
+        write(addr + cmd);
+        if (cmd == "gs") {
+            response = read();
+        }
+    } catch (timeout_exception &) {
+    } catch (std::exception &ex) {
+        std::cout << "background job on " << addr << " failed: " << ex.what() << std::endl;
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        for (ell_job &job : _jobs) {
+            if (job.info.id == id) {
+                job.info.state = JOB_FAILED;
+                job.info.status = GENERAL_ERROR;
+            }
+        }
+    }
+    bserial->setTimeout(boost::posix_time::seconds(_ser_timeout));
+    _background_io = false;
+
+    if ((response.length() >= 5) && !response.substr(1,2).compare(std::string("GS")) && !response.substr(0,1).compare(addr)) {
+        std::lock_guard<std::mutex> lock(_jobmtx);
+        for (ell_job &job : _jobs) {
+            if ((job.info.id == id) && (job.info.state == JOB_RUNNING)) {
+                job_status(job, parsestatus(std::string(response)));
+            }
+        }
+    }
+}
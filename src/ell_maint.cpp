@@ -0,0 +1,204 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Maintenance
+ *
+ *****************************************/
+namespace {
+
+struct maint_task {
+    ell_maint_result result;
+    std::vector<std::string> steps;
+    size_t step = 0;
+    bool active = false;
+    bool stopping = false;
+    bool step_done = false;     //non-busy status seen for current step
+    uint8_t step_code = 0;
+    uint16_t pending = 0;       //replies still expected from device
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point last_poll;
+    std::chrono::steady_clock::time_point step_done_at;
+};
+
+}
+
+std::vector<std::string> elliptec::maint_steps(std::string addr, ell_maint_op op) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    uint16_t type = dev.value().type;
+    uint8_t nmotors = 0;
+    if (devintype("linrot", type)) {
+        nmotors = 2;
+    } else if (devintype("indexed", type)) {
+        nmotors = 1;
+    }
+
+    std::vector<std::string> steps;
+    switch (op) {
+        case MAINT_OPTIMIZE:
+            if (devintype("hasclean", type)) {
+                steps.push_back("om");
+            }
+            break;
+        case MAINT_CLEAN:
+            if (devintype("hasclean", type)) {
+                steps.push_back("cm");
+            }
+            break;
+        case MAINT_SEARCH_FREQ:
+            for (uint8_t m = 1; m <= nmotors; ++m) {
+                steps.push_back("s" + std::to_string(m));
+            }
+            if (!steps.empty()) {
+                steps.push_back("us");
+            }
+            break;
+        case MAINT_SCAN_CURRENT:
+            for (uint8_t m = 1; m <= nmotors; ++m) {
+                steps.push_back("c" + std::to_string(m));
+            }
+            break;
+    }
+    return steps;
+}
+
+// Starts op on all addresses at once and tracks every device by polling gs
+// round-robin. Replies are matched by address, so devices finishing in any
+// order are handled. cancel is checked on every pass and sends st to every
+// device still working.
+std::vector<ell_maint_result> elliptec::run_maintenance(ell_maint_op op, std::vector<std::string> addrs, std::function<bool()> cancel) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    using clock = std::chrono::steady_clock;
+    const auto poll_interval = std::chrono::milliseconds(MAINT_POLL_MS);
+    const auto drain = std::chrono::milliseconds(MAINT_DRAIN_MS);
+
+    if (addrs.empty()) {
+        addrs = mids;
+    }
+
+    std::vector<maint_task> tasks(addrs.size());
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        maint_task &t = tasks.at(i);
+        t.result.address = addrs.at(i);
+        t.result.op = op;
+        t.steps = maint_steps(addrs.at(i), op);
+        if (t.steps.empty()) {
+            t.result.status = COMMAND_ERR;
+        }
+    }
+
+    // all devices start back-to-back, nobody waits for a reply
+    for (maint_task &t : tasks) {
+        if (t.steps.empty()) {
+            continue;
+        }
+        t.active = true;
+        t.started = clock::now();
+        t.last_poll = t.started;
+        t.pending = 1;
+        write(t.result.address + t.steps.front());
+    }
+
+    auto finish = [](maint_task &t, uint8_t code, bool completed) {
+        t.active = false;
+        t.result.status = code;
+        t.result.completed = completed;
+        t.result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t.started);
+    };
+
+    bserial->setTimeout(boost::posix_time::milliseconds(MAINT_READ_MS));
+    std::vector<std::string_view> frames;
+    try {
+        size_t next = 0;
+        while (std::any_of(tasks.begin(), tasks.end(), [](const maint_task &t) { return t.active; })) {
+            auto now = clock::now();
+
+            if (cancel && cancel()) {
+                for (maint_task &t : tasks) {
+                    if (t.active && !t.stopping) {
+                        t.stopping = true;
+                        t.result.cancelled = true;
+                        t.step_done = false;
+                        t.last_poll = now;
+                        ++t.pending;
+                        write(t.result.address + "st");
+                    }
+                }
+            }
+
+            // advance devices whose step is done and whose replies are drained
+            for (maint_task &t : tasks) {
+                if (!t.active || !t.step_done) {
+                    continue;
+                }
+                if ((t.pending > 0) && (now - t.step_done_at < drain)) {
+                    continue;
+                }
+                if (t.stopping || (t.step_code != OK)) {
+                    finish(t, t.step_code, false);
+                } else if (++t.step < t.steps.size()) {
+                    t.step_done = false;
+                    t.pending = 1;
+                    t.last_poll = now;
+                    write(t.result.address + t.steps.at(t.step));
+                } else {
+                    finish(t, OK, true);
+                }
+            }
+
+            // one gs per pass, to the next device that is due
+            for (size_t k = 0; k < tasks.size(); ++k) {
+                size_t i = (next + k) % tasks.size();
+                maint_task &t = tasks.at(i);
+                if (t.active && !t.step_done && (now - t.last_poll >= poll_interval)) {
+                    t.last_poll = now;
+                    ++t.pending;
+                    write(t.result.address + "gs");
+                    next = i + 1;
+                    break;
+                }
+            }
+
+            // replies of several devices often arrive together, take them all
+            frames.clear();
+            try {
+                read_frames(frames);
+            } catch (timeout_exception &) {
+                continue;
+            }
+            for (std::string_view response : frames) {
+                if ((response.length() < 5) || response.substr(1,2).compare("GS")) {
+                    continue;
+                }
+                for (maint_task &t : tasks) {
+                    if (!t.active || t.result.address.compare(response.substr(0,1))) {
+                        continue;
+                    }
+                    if (t.pending > 0) {
+                        --t.pending;
+                    }
+                    uint8_t code = parsestatus(std::string(response));
+                    if ((code != BUSY) && !t.step_done) {
+                        t.step_done = true;
+                        t.step_code = code;
+                        t.step_done_at = clock::now();
+                    }
+                }
+            }
+        }
+    } catch (...) {
+        bserial->setTimeout(boost::posix_time::seconds(_ser_timeout));
+        throw;
+    }
+    bserial->setTimeout(boost::posix_time::seconds(_ser_timeout));
+
+    std::vector<ell_maint_result> results;
+    results.reserve(tasks.size());
+    for (const maint_task &t : tasks) {
+        results.push_back(t.result);
+    }
+    return results;
+}
@@ -0,0 +1,228 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Health monitor
+ *
+ *****************************************/
+void elliptec::start_health_monitor(ell_monitor_config cfg, std::function<void(const ell_alert&)> on_alert) {
+    if ((cfg.bus_fraction <= 0) || (cfg.bus_fraction > 1)) {
+        throw std::invalid_argument("bus_fraction has to be in (0, 1]");
+    }
+    stop_health_monitor();
+    {
+        std::lock_guard<std::mutex> lock(_monmtx);
+        _monitor_stop = false;
+    }
+    _monthread = std::thread(&elliptec::monitor_loop, this, cfg, on_alert);
+}
+
+void elliptec::stop_health_monitor() {
+    {
+        std::lock_guard<std::mutex> lock(_monmtx);
+        _monitor_stop = true;
+    }
+    _moncv.notify_all();
+    if (_monthread.joinable()) {
+        _monthread.join();
+    }
+}
+
+namespace {
+
+struct motor_health {
+    uint16_t samples = 0;
+    double current = 0;         //baselines, averaged over the first samples
+    double period_fwd = 0;
+    double period_bwd = 0;
+    bool current_alerted = false;
+    bool freq_alerted = false;
+};
+
+struct background_io {
+    bool &flag;
+    explicit background_io(bool &f) : flag(f) { flag = true; }
+    ~background_io() { flag = false; }
+};
+
+struct device_health {
+    std::vector<uint8_t> codes; //recent status codes
+    motor_health motors[2];
+    uint32_t rounds = 0;
+};
+
+}
+
+// Samples one query at a time, round-robin over devices. Wire time of every
+// frame (request plus reply) is charged against a budget that refills at
+// bus_fraction seconds per second, so the monitor never uses more than that
+// share of the bus. Queries are only sent when the bus is free and no motion
+// command ended within motion_holdoff.
+void elliptec::monitor_loop(ell_monitor_config cfg, std::function<void(const ell_alert&)> on_alert) {
+    using clock = std::chrono::steady_clock;
+    const auto tick = std::chrono::milliseconds(2*MAINT_READ_MS);
+    std::unordered_map<std::string, device_health> health;
+    std::vector<std::string> queue;     //queries left for the current device
+    std::string addr = "";
+    size_t dev_idx = 0;
+    double credit = 0;
+    auto last = clock::now();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_monmtx);
+            _moncv.wait_for(lock, tick, [this] { return _monitor_stop; });
+            if (_monitor_stop) {
+                return;
+            }
+        }
+        auto now = clock::now();
+        credit += cfg.bus_fraction * std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        std::vector<ell_alert> alerts;
+        {
+            std::unique_lock<std::recursive_mutex> bus(_busmtx, std::try_to_lock);
+            if (!bus.owns_lock() || (now - _last_motion < cfg.motion_holdoff) || mids.empty()) {
+                continue;
+            }
+            background_io quiet(_background_io);
+
+            if (queue.empty()) {
+                dev_idx = (dev_idx + 1) % mids.size();
+                addr = mids.at(dev_idx);
+                auto dev = devinfo_at_addr(addr);
+                if (!dev.has_value()) {
+                    continue;
+                }
+                uint8_t nmotors = 0;
+                if (devintype("linrot", dev.value().type)) {
+                    nmotors = 2;
+                } else if (devintype("indexed", dev.value().type)) {
+                    nmotors = 1;
+                }
+                device_health &h = health[addr];
+                queue.push_back("gs");
+                for (uint8_t m = 1; m <= nmotors; ++m) {
+                    queue.push_back("i" + std::to_string(m));
+                }
+                if (cfg.sample_curves && (cfg.curve_every > 0) && (h.rounds % cfg.curve_every == 0)) {
+                    for (uint8_t m = 1; m <= nmotors; ++m) {
+                        queue.push_back("C" + std::to_string(m));
+                    }
+                }
+                ++h.rounds;
+            }
+
+            // expected reply sizes including \r\n: GS 7, I1 27, C1 527
+            std::string cmd = queue.front();
+            size_t reply_len = 7;
+            if (cmd[0] == 'i') {
+                reply_len = 27;
+            } else if (cmd[0] == 'C') {
+                reply_len = 5 + 6*ELL_CURVE_POINTS;
+            }
+            double cost = CHAR_TIME * (addr.length() + cmd.length() + reply_len);
+            credit = std::min(credit, std::max(cost, cfg.bus_fraction));
+            if (credit < cost) {
+                continue;
+            }
+            queue.erase(queue.begin());
+
+            std::string response = "";
+            bserial->setTimeout(boost::posix_time::milliseconds(MAINT_POLL_MS + long(1000*cost)));
+            try {
+                write(addr + cmd);
+                response = read();
+            } catch (timeout_exception &) {
+            } catch (std::exception &ex) {
+                std::cout << "health monitor: " << ex.what() << std::endl;
+            }
+            bserial->setTimeout(boost::posix_time::seconds(_ser_timeout));
+
+            credit -= response.empty() ? cost : CHAR_TIME * (addr.length() + cmd.length() + response.length() + 2);
+            if ((response.length() < 5) || response.substr(0,1).compare(addr)) {
+                continue;
+            }
+
+            device_health &h = health[addr];
+            auto alert = [&](ell_alert_kind kind, uint8_t motor, double value, double baseline, std::string message) {
+                ell_alert a;
+                a.address = addr;
+                a.kind = kind;
+                a.motor = motor;
+                a.value = value;
+                a.baseline = baseline;
+                a.message = message;
+                a.time = std::chrono::system_clock::now();
+                alerts.push_back(a);
+            };
+
+            std::string type = response.substr(1,2);
+            if (!type.compare("GS")) {
+                h.codes.push_back(parsestatus(response));
+                if (h.codes.size() > cfg.error_window) {
+                    h.codes.erase(h.codes.begin());
+                }
+                size_t n = std::count_if(h.codes.begin(), h.codes.end(), [](uint8_t c) { return (c == THERMAL_ERROR) || (c == OVER_CURRENT); });
+                if ((cfg.error_repeat > 0) && (n >= cfg.error_repeat)) {
+                    alert(ALERT_DEVICE_ERROR, 0, n, 0, err2string(h.codes.back()) + " reported " + std::to_string(n) + " times");
+                    h.codes.clear();
+                }
+            } else if ((type[0] == 'I') && (response.length() >= 25)) {
+                ell_motor_info info;
+                try {
+                    info = parse_motor_info(response);
+                } catch (std::exception &) {
+                    continue;
+                }
+                if ((info.motor < 1) || (info.motor > 2)) {
+                    continue;
+                }
+                motor_health &mh = h.motors[info.motor-1];
+                if (mh.samples < cfg.baseline_samples) {
+                    ++mh.samples;
+                    mh.current += (info.current - mh.current) / mh.samples;
+                    mh.period_fwd += (info.period_fwd - mh.period_fwd) / mh.samples;
+                    mh.period_bwd += (info.period_bwd - mh.period_bwd) / mh.samples;
+                } else {
+                    double limit = mh.current * (1 + cfg.current_rise);
+                    if (!mh.current_alerted && (info.current > limit)) {
+                        mh.current_alerted = true;
+                        alert(ALERT_CURRENT_RISE, info.motor, info.current/1.866, mh.current/1.866, "motor current rose above baseline");
+                    } else if (info.current < mh.current * (1 + cfg.current_rise/2)) {
+                        mh.current_alerted = false;
+                    }
+                    double drift = std::max(std::abs(info.period_fwd - mh.period_fwd) / mh.period_fwd,
+                                            std::abs(info.period_bwd - mh.period_bwd) / mh.period_bwd);
+                    if (!mh.freq_alerted && (drift > cfg.freq_drift)) {
+                        mh.freq_alerted = true;
+                        alert(ALERT_FREQ_DRIFT, info.motor, 14740000.0/info.period_fwd, 14740000.0/mh.period_fwd, "motor frequency drifted from baseline");
+                    } else if (drift < cfg.freq_drift/2) {
+                        mh.freq_alerted = false;
+                    }
+                }
+            } else if ((type[0] == 'C') && (cfg.curve_path != "")) {
+                ell_curve_record rec{};
+                auto dev = devinfo_at_addr(addr);
+                if (dev.has_value() && ell_curve_decode(std::string_view(response).substr(3), rec.period, rec.current)) {
+                    rec.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    rec.serial = dev.value().serial;
+                    rec.address = std::stoi(addr, nullptr, 16);
+                    rec.motor = type[1] - '0';
+                    try {
+                        ell_curve_writer(cfg.curve_path).append(rec);
+                    } catch (std::exception &ex) {
+                        std::cout << "health monitor: " << ex.what() << std::endl;
+                    }
+                }
+            }
+        }
+
+        if (on_alert) {
+            for (const ell_alert &a : alerts) {
+                on_alert(a);
+            }
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Motion events
+ *
+ *****************************************/
+uint32_t elliptec::subscribe_motion(std::function<void(const ell_motion_event&)> on_event) {
+    std::lock_guard<std::mutex> lock(_motionmtx);
+    uint32_t id = _next_motion_sub++;
+    _motion_subs[id] = on_event;
+    return id;
+}
+
+void elliptec::unsubscribe_motion(uint32_t id) {
+    std::lock_guard<std::mutex> lock(_motionmtx);
+    _motion_subs.erase(id);
+}
+
+std::vector<ell_motion_event> elliptec::motion_events() {
+    std::lock_guard<std::mutex> lock(_motionmtx);
+    std::vector<ell_motion_event> events(_motion_events.begin(), _motion_events.end());
+    _motion_events.clear();
+    return events;
+}
+
+// Subscribers run on the thread issuing the motion command, with the bus
+// held, and must not call back into elliptec
+void elliptec::emit_motion(ell_motion_event ev) {
+    ev.time = std::chrono::steady_clock::now();
+    std::vector<std::function<void(const ell_motion_event&)>> subs;
+    {
+        std::lock_guard<std::mutex> lock(_motionmtx);
+        _motion_events.push_back(ev);
+        while (_motion_events.size() > MOTION_EVENTS) {
+            _motion_events.pop_front();
+        }
+        for (auto &s : _motion_subs) {
+            subs.push_back(s.second);
+        }
+    }
+    for (auto &on_event : subs) {
+        on_event(ev);
+    }
+}
+
+void elliptec::motion_write(const std::string &msg) {
+    {
+        std::lock_guard<std::mutex> lock(_stopmtx);
+        std::erase(_stop_requests, msg.substr(0,1));
+    }
+    write(msg);
+    _motion_cmd = msg;
+    ell_motion_event ev;
+    ev.address = msg.substr(0,1);
+    ev.kind = MOTION_STARTED;
+    ev.command = msg;
+    emit_motion(ev);
+}
+
+// Reads until the device reports the end of the last motion_write():
+// busy status is passed on as an event and waited through, a position or
+// status reply ends the motion
+ell_response elliptec::motion_response() {
+    while (true) {
+        ell_response ret = process_response();
+        ell_motion_event ev;
+        ev.address = int2addr(ret.address);
+        ev.command = _motion_cmd;
+        if (!ret.type.compare("GS")) {
+            ev.code = std::stoi(ret.data.substr(0,2), nullptr, 16);
+            if (ev.code == BUSY) {
+                ev.kind = MOTION_BUSY;
+                ev.message = err2string(ev.code);
+                emit_motion(ev);
+                continue;
+            }
+            ev.kind = (ev.code == OK) ? MOTION_REACHED : MOTION_ERROR;
+            if (ev.code != OK) {
+                ev.message = err2string(ev.code);
+            }
+        } else if (!ret.type.compare("PO")) {
+            ev.kind = MOTION_REACHED;
+            if (devislinear(ev.address)) {
+                ev.position = step2mm(ev.address, hex2step(ret.data));
+            } else if (devisrotary(ev.address)) {
+                ev.position = step2deg(ev.address, hex2step(ret.data));
+            }
+        } else if ((ret.type.length() == 2) && (ret.type[0] == 'P')) {
+            ev.kind = MOTION_REACHED;
+            ev.position = PADDLE_DEG_PER_STEP*hex2step(ret.data);
+        } else {
+            return ret;
+        }
+        emit_motion(ev);
+        return ret;
+    }
+}
@@ -0,0 +1,192 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Multi-axis moves
+ *
+ *****************************************/
+// Nominal full-speed figures from the datasheets. Equal arrival only
+// depends on their ratios; the absolute values set the predicted time.
+double elliptec::full_speed(std::string addr) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    switch (dev.value().type) {
+        case 7:  return 90;     //mm/s
+        case 8:  return 50;     //deg/s
+        case 10: return 90;     //mm/s
+        case 14: return 430;    //deg/s
+        case 17: return 180;    //mm/s
+        case 18: return 430;    //deg/s
+        case 20: return 180;    //mm/s
+    }
+    throw std::invalid_argument("Only linear and rotary devices support move_together");
+}
+
+// Axes are written longest first, back to back, so the short movers start
+// last. Each gets the velocity that makes it arrive with the longest one,
+// from its own start, but not below VELOCITY_MIN_PERCENT. sv is only sent
+// when the velocity last set on the device differs; velocities are left as
+// scheduled, so repeating a move pattern costs no sv at all.
+ell_multi_move_result elliptec::move_together(const std::vector<std::pair<std::string, double>> &targets, bool equal_arrival) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    struct axis {
+        std::string addr;
+        std::string cmd;
+        double target = 0;          //deg or mm
+        double seconds = 0;         //travel time at 100 %
+        uint8_t percent = 100;
+        bool arrived = false;
+        double position = std::nan("");
+    };
+    std::vector<std::unique_ptr<motion_scope>> motion;
+    std::vector<axis> axes;
+    for (const auto &[addr, pos] : targets) {
+        if (!devislinrot(addr)) {
+            throw std::invalid_argument("Only linear and rotary devices support move_together");
+        }
+        motion.push_back(std::make_unique<motion_scope>(*this, addr, true));
+        int64_t target = devislinear(addr) ? mm2step(addr, pos) : deg2step(addr, pos);
+        if (_positions.find(addr) == _positions.end()) {
+            get_position(addr);
+        }
+        int64_t travel = std::llabs(target - _positions[addr]);
+        axis a;
+        a.addr = addr;
+        a.cmd = addr + "ma" + step2hex(target);
+        a.target = pos;
+        a.seconds = (devislinear(addr) ? step2mm(addr, travel) : step2deg(addr, travel))/full_speed(addr);
+        if (!equal_arrival) {
+            a.percent = std::max<uint8_t>(get_velocity(addr), 1);
+        }
+        axes.push_back(a);
+    }
+    std::vector<size_t> order(axes.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return axes[a].seconds > axes[b].seconds; });
+
+    const double frame = 11*CHAR_TIME;      //"Ama" + 8 hex digits
+    const double reply = 13*CHAR_TIME;      //"APO" + 8 hex digits + "\r\n"
+    double longest = axes.empty() ? 0 : axes[order[0]].seconds;
+    double arrival = 0;
+    for (size_t k = 0; k < order.size(); ++k) {
+        axis &a = axes[order[k]];
+        double start = (k + 1)*frame;
+        if (equal_arrival) {
+            double window = longest + frame - start;
+            double percent = (window > 0) ? std::ceil(100*a.seconds/window) : 100;
+            a.percent = uint8_t(std::clamp<double>(percent, VELOCITY_MIN_PERCENT, 100));
+            auto cached = cached_velocity(a.addr);
+            if (!cached.has_value() || (cached.value() != a.percent)) {
+                set_velocity(a.addr, a.percent);
+            }
+        }
+        arrival = std::max(arrival, start + a.seconds*100/a.percent);
+    }
+
+    ell_multi_move_result res;
+    res.predicted = std::chrono::milliseconds(std::lround(1000*(arrival + reply)));
+    for (const axis &a : axes) {
+        res.velocity.push_back(a.percent);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i : order) {
+        motion_write(axes[i].cmd);
+    }
+    size_t left = axes.size();
+    auto take = [&](const ell_response &ret) {
+        for (axis &a : axes) {
+            if (!a.arrived && !a.addr.compare(int2addr(ret.address))) {
+                a.arrived = true;
+                --left;
+                if (!ret.type.compare("PO")) {
+                    int64_t step = hex2step(ret.data);
+                    a.position = devislinear(a.addr) ? step2mm(a.addr, step) : step2deg(a.addr, step);
+                }
+                return;
+            }
+        }
+    };
+    // Replies come in order of arrival, from whichever axis finishes. With
+    // equal arrival they come close together and can overlap on the return
+    // line; a reply that cannot be read ends the wait.
+    try {
+        while (left > 0) {
+            for (size_t i : order) {
+                if (!axes[i].arrived) {
+                    _expect_addr = axes[i].addr;
+                    _motion_cmd = axes[i].cmd;
+                    break;
+                }
+            }
+            take(motion_response());
+        }
+    } catch (std::exception &ex) {
+        if (!_quiet) {
+            std::cout << "move_together: " << ex.what() << ", asking the axes that have not reported" << std::endl;
+        }
+    }
+    // Every axis that has not reported is asked once the predicted arrival
+    // has passed: gs until it is no longer busy, then gp. A late position
+    // reply of any axis counts as its report; the status of an axis still
+    // moving does not. An axis that does not answer is given up as not
+    // reached.
+    auto reply_of = [&](const axis &a, const std::string &type) {
+        std::string response = read();
+        while (response.substr(0,1).compare(a.addr) || response.substr(1,2).compare(type)) {
+            if (!response.substr(1,2).compare("PO")) {
+                take(process_response(response));
+            }
+            response = read();
+        }
+        return response;
+    };
+    if (left > 0) {
+        std::this_thread::sleep_until(start + res.predicted);
+        if (!_reader_running) {
+            bserial->flush();
+        }
+        for (axis &a : axes) {
+            try {
+                while (!a.arrived) {
+                    write(a.addr + "gs");
+                    std::string status = reply_of(a, "GS");
+                    if (a.arrived) {
+                        break;
+                    }
+                    if (parsestatus(status) == BUSY) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(MULTI_POLL_MS));
+                        continue;
+                    }
+                    write(a.addr + "gp");
+                    take(process_response(reply_of(a, "PO")));
+                }
+            } catch (std::exception &ex) {
+                if (!_quiet) {
+                    std::cout << "move_together: axis " << a.addr << ": " << ex.what() << std::endl;
+                }
+                if (!a.arrived) {
+                    a.arrived = true;
+                    --left;
+                }
+            }
+        }
+    }
+    res.actual = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    for (const axis &a : axes) {
+        bool reached = std::abs(a.position - a.target) <= (devislinear(a.addr) ? MMERR : DEGERR);
+        res.position.push_back(a.position);
+        res.reached.push_back(reached);
+        if (!reached && !_quiet) {
+            std::cout << "axis " << a.addr << " did not reach its target: at " << a.position << " instead of " << a.target << std::endl;
+        }
+    }
+    if (!_quiet) {
+        std::cout << "move_together: predicted " << res.predicted.count() << " ms, took " << res.actual.count() << " ms" << std::endl;
+    }
+    return res;
+}
@@ -0,0 +1,123 @@
+#include "ell.h"
+
+#include <future>
+
+/*****************************************
+ *
+ * Paddle optimiser
+ *
+ *****************************************/
+// Sends one paddle command and, if value is given, measures the metric
+// where the paddle stops. The device replies once the paddle has stopped,
+// so when the transport sees the reply start the metric is taken right
+// away and runs while the rest of the reply is read and parsed.
+// \return paddle position in deg
+double elliptec::paddle_probe(const std::string &msg, const std::function<double()> &metric, double *value) {
+    motion_write(msg);
+    std::future<double> measured;
+    if (value && !_reader_running && bserial->detects_rx_start() && bserial->rx_started(bserial->deadline())) {
+        measured = std::async(std::launch::async, metric);
+    }
+    ell_response ret = motion_response();
+    if ((ret.type.length() != 2) || (ret.type[0] != 'P')) {
+        if (measured.valid()) {
+            measured.wait();
+        }
+        std::string why = "unexpected reply " + ret.type + ret.data;
+        if (!ret.type.compare("GS")) {
+            why = err2string(std::stoi(ret.data.substr(0,2), nullptr, 16));
+        }
+        throw std::runtime_error("paddle command " + msg + " failed: " + why);
+    }
+    if (value) {
+        *value = measured.valid() ? measured.get() : metric();
+    }
+    return PADDLE_DEG_PER_STEP*hex2step(ret.data);
+}
+
+// Coarse sweep of each paddle in drive time steps, then a coordinate search
+// with absolute moves whose step halves whenever a round brings no gain.
+// A rejected trial moves straight on to the next one; only a paddle whose
+// trials all failed is moved back. Nothing is printed; iterations and
+// their rate come back in the result.
+ell_paddle_opt_result elliptec::optimize_paddles(std::string addr, std::function<double()> metric, ell_paddle_opt_config cfg) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
+    if (!devispaddle(addr)) {
+        throw std::invalid_argument("only paddles support command -optimize_paddles-");
+    }
+    if (!metric) {
+        throw std::invalid_argument("optimize_paddles needs a metric");
+    }
+    quiet_scope quiet(*this);
+
+    auto moveto = [&](int p, double deg) {
+        deg = std::clamp(deg, 0.0, PADDLE_RANGE_DEG);
+        return addr + "a" + std::to_string(p + 1) + step2hex(std::lround(deg/PADDLE_DEG_PER_STEP), 4);
+    };
+    ell_paddle_opt_result res;
+    double value = 0;
+    auto measure = [&](const std::string &msg) {
+        double pos = paddle_probe(msg, metric, &value);
+        ++res.iterations;
+        return pos;
+    };
+    auto budget = [&] { return res.iterations < cfg.max_iterations; };
+    auto start = std::chrono::steady_clock::now();
+
+    std::array<double, 3> at;
+    for (int p = 0; p < 3; ++p) {
+        at[p] = paddle_probe(moveto(p, cfg.start[p]), metric, nullptr);
+    }
+    res.position = at;
+    res.metric = metric();
+    ++res.iterations;
+
+    if (cfg.coarse_ms > 0) {
+        std::string drive = us2hex(std::min<uint16_t>(cfg.coarse_ms, 0x7FFF) | 0x8000);
+        for (int p = 0; p < 3; ++p) {
+            for (uint16_t k = 0; (k < cfg.coarse_steps) && budget(); ++k) {
+                at[p] = measure(addr + "t" + std::to_string(p + 1) + drive);
+                if (value > res.metric) {
+                    res.metric = value;
+                    res.position[p] = at[p];
+                }
+            }
+            if (at[p] != res.position[p]) {
+                at[p] = paddle_probe(moveto(p, res.position[p]), metric, nullptr);
+            }
+        }
+    }
+
+    double step = cfg.step;
+    while ((step >= cfg.min_step) && budget()) {
+        bool improved = false;
+        for (int p = 0; (p < 3) && budget(); ++p) {
+            for (double dir : {1.0, -1.0}) {
+                double target = std::clamp(res.position[p] + dir*step, 0.0, PADDLE_RANGE_DEG);
+                if (!budget() || (std::abs(target - res.position[p]) < PADDLE_DEG_PER_STEP/2)) {
+                    continue;
+                }
+                at[p] = measure(moveto(p, target));
+                if (value > res.metric) {
+                    res.metric = value;
+                    res.position[p] = at[p];
+                    improved = true;
+                    break;
+                }
+            }
+            if (at[p] != res.position[p]) {
+                at[p] = paddle_probe(moveto(p, res.position[p]), metric, nullptr);
+            }
+        }
+        if (!improved) {
+            step /= 2;
+        }
+    }
+
+    res.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (res.duration.count() > 0) {
+        res.iterations_per_s = 1000.0*res.iterations/res.duration.count();
+    }
+    return res;
+}
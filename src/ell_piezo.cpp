@@ -0,0 +1,76 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Piezo sweep
+ *
+ *****************************************/
+std::string elliptec::piezo_frame(const std::string &addr, double freq_hz) {
+    if ((freq_hz < 230) || (freq_hz > 2000000)) {
+        throw std::invalid_argument("Frequency needs to be between 23Hz and 2MHz");
+    }
+    uint32_t period = std::llround(PIEZO_CLOCK_HZ/freq_hz);
+    return addr + "e1" + step2hex(period,4);
+}
+
+// Steps are scheduled on the monotonic clock relative to the start of the
+// sweep, so a late step does not shift the ones after it. The last
+// SWEEP_SPIN_US before each step are busy waited instead of slept.
+size_t elliptec::piezo_sweep(std::string addr, const std::vector<double> &freqs_hz, std::chrono::microseconds dwell, std::function<bool(const ell_sweep_step&)> on_step) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr);
+    if (!devispiezo(addr)) {
+        throw std::invalid_argument("only piezo ELL5 can be energized");
+    }
+    std::vector<std::string> frames;
+    frames.reserve(freqs_hz.size());
+    for (double f : freqs_hz) {
+        frames.push_back(piezo_frame(addr, f));
+    }
+
+    quiet_scope quiet(*this);
+    const auto spin = std::chrono::microseconds(SWEEP_SPIN_US);
+    size_t done = 0;
+    try {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < frames.size(); ++i) {
+            auto due = start + i*dwell;
+            std::this_thread::sleep_until(due - spin);
+            while (std::chrono::steady_clock::now() < due) {
+            }
+            ell_sweep_step step;
+            step.index = i;
+            step.freq_hz = freqs_hz[i];
+            step.actual_hz = PIEZO_CLOCK_HZ/hex2step(frames[i].substr(3));
+            step.sent = std::chrono::steady_clock::now();
+            step.lag = std::chrono::duration_cast<std::chrono::microseconds>(step.sent - due);
+            write(frames[i]);
+            step.status = parsestatus(read());
+            ++done;
+            if (step.status != OK) {
+                std::cout << "sweep step " << i << ": " << err2string(step.status) << std::endl;
+            }
+            if (on_step && !on_step(step)) {
+                break;
+            }
+        }
+    } catch (...) {
+        halt_motor(addr);
+        throw;
+    }
+    halt_motor(addr);
+    return done;
+}
+
+size_t elliptec::piezo_sweep(std::string addr, double start_hz, double stop_hz, double step_hz, std::chrono::microseconds dwell, std::function<bool(const ell_sweep_step&)> on_step) {
+    if ((step_hz <= 0) || (stop_hz < start_hz)) {
+        throw std::invalid_argument("sweep needs start <= stop and a positive step");
+    }
+    std::vector<double> freqs;
+    size_t n = std::floor((stop_hz - start_hz)/step_hz + 1e-9) + 1;
+    freqs.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        freqs.push_back(start_hz + i*step_hz);
+    }
+    return piezo_sweep(addr, freqs, dwell, on_step);
+}
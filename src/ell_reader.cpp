@@ -0,0 +1,180 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Reader thread
+ *
+ *****************************************/
+static int addr_index(std::string_view addr) {
+    if (addr.empty() || !std::isxdigit(static_cast<unsigned char>(addr[0]))) {
+        return -1;
+    }
+    return std::stoi(std::string(addr.substr(0,1)), nullptr, 16);
+}
+
+// on_frame runs on the reader thread and must not call back into elliptec
+void elliptec::start_reader(std::function<void(const ell_frame_event&)> on_frame) {
+    stop_reader();
+    std::lock_guard<std::recursive_mutex> bus(_busmtx);
+    if (!bserial->concurrent_io()) {
+        throw std::runtime_error("transport does not support a reader thread, use the posix, tcp or loopback transport");
+    }
+    std::string stale;
+    for (size_t i = 0; i < _mailboxes.size(); ++i) {
+        _awaiting[i] = false;
+        while (_mailboxes[i].pop(stale)) {
+        }
+    }
+    _reader_stop = false;
+    _reader_running = true;
+    _readerthread = std::thread(&elliptec::reader_loop, this, on_frame);
+}
+
+void elliptec::stop_reader() {
+    std::lock_guard<std::recursive_mutex> bus(_busmtx);
+    if (!_readerthread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mailmtx);
+        _reader_stop = true;
+    }
+    _mailcv.notify_all();
+    bserial->cancel();
+    _readerthread.join();
+    bserial->clear_cancel();
+    _reader_running = false;
+}
+
+bool elliptec::reader_running() {
+    return _reader_running;
+}
+
+std::vector<ell_frame_event> elliptec::frame_events() {
+    std::lock_guard<std::mutex> lock(_mailmtx);
+    std::vector<ell_frame_event> events(_events.begin(), _events.end());
+    _events.clear();
+    return events;
+}
+
+void elliptec::reader_loop(std::function<void(const ell_frame_event&)> on_frame) {
+    const auto tick = std::chrono::milliseconds(2*MAINT_READ_MS);
+    std::vector<std::string_view> frames;
+    std::vector<ell_frame_event> events;
+    while (!_reader_stop) {
+        frames.clear();
+        try {
+            bserial->read_frames(frames, std::chrono::steady_clock::now() + tick);
+        } catch (timeout_exception &) {
+            continue;
+        } catch (std::exception &ex) {
+            std::cout << "reader: " << ex.what() << std::endl;
+            std::this_thread::sleep_for(tick);
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        events.clear();
+        for (std::string_view frame : frames) {
+            ell_frame_event ev;
+            ev.frame = std::string(frame);
+            ev.address = std::string(frame.substr(0,1));
+            ev.received = now;
+            int i = addr_index(ev.address);
+            if ((i >= 0) && _awaiting[i]) {
+                ev.solicited = _mailboxes[i].push(std::string(frame));
+            }
+            if (!ev.solicited) {
+                route_job_status(frame);
+            }
+            events.push_back(std::move(ev));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mailmtx);
+            _events.insert(_events.end(), events.begin(), events.end());
+            while (_events.size() > READER_EVENTS) {
+                _events.pop_front();
+            }
+        }
+        _mailcv.notify_all();
+        if (on_frame) {
+            for (const ell_frame_event &ev : events) {
+                on_frame(ev);
+            }
+        }
+    }
+}
+
+// A new command makes everything still queued for its address stale:
+// late replies to earlier commands must not answer this one.
+void elliptec::expect_reply_from(std::string addr) {
+    _expect_addr = addr;
+    int i = addr_index(addr);
+    if (i < 0) {
+        return;
+    }
+    std::string stale;
+    while (_mailboxes[i].pop(stale)) {
+    }
+    _awaiting[i] = true;
+}
+
+// read() while the reader thread runs
+std::string elliptec::read_mailbox(std::chrono::steady_clock::time_point deadline) {
+    int i = addr_index(_expect_addr);
+    if (i < 0) {
+        throw std::runtime_error("no reply expected");
+    }
+    {
+        std::unique_lock<std::mutex> lock(_mailmtx);
+        auto ready = [this, i] { return !_mailboxes[i].empty() || _reader_stop; };
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            _mailcv.wait(lock, ready);
+        } else {
+            _mailcv.wait_until(lock, deadline, ready);
+        }
+    }
+    std::string response;
+    if (!_mailboxes[i].pop(response)) {
+        _awaiting[i] = false;
+        throw timeout_exception("Timeout expired");
+    }
+    if (!_background_io && !_quiet) {
+        std::cout << "got response " << response << std::endl;
+    }
+    return response;
+}
+
+// read_frames() while the reader thread runs
+size_t elliptec::read_mailboxes(std::vector<std::string_view> &frames) {
+    auto any = [this] {
+        return std::any_of(_mailboxes.begin(), _mailboxes.end(), [](const ell_mailbox &m) { return !m.empty(); });
+    };
+    auto deadline = bserial->deadline();
+    {
+        std::unique_lock<std::mutex> lock(_mailmtx);
+        auto ready = [this, &any] { return any() || _reader_stop; };
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            _mailcv.wait(lock, ready);
+        } else {
+            _mailcv.wait_until(lock, deadline, ready);
+        }
+    }
+    _mail_batch.clear();
+    std::string response;
+    for (ell_mailbox &m : _mailboxes) {
+        while (m.pop(response)) {
+            _mail_batch.push_back(std::move(response));
+        }
+    }
+    if (_mail_batch.empty()) {
+        throw timeout_exception("Timeout expired");
+    }
+    for (const std::string &frame : _mail_batch) {
+        if (!_background_io && !_quiet) {
+            std::cout << "got response " << frame << std::endl;
+        }
+        frames.push_back(frame);
+    }
+    return _mail_batch.size();
+}
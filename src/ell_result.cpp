@@ -0,0 +1,340 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Result API
+ *
+ *****************************************/
+static ell_unexpected fail(ell_error_kind kind, const std::string &addr, const std::string &message, uint8_t code = 0) {
+    ell_error e;
+    e.kind = kind;
+    e.code = code;
+    e.address = addr;
+    e.message = message;
+    return ell_unexpected(std::move(e));
+}
+
+ell_expected<ell_device> elliptec::try_device(const std::string &addr) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        return fail(ERR_INVALID, addr, "Device with address " + addr + " not in connected device list");
+    }
+    return dev.value();
+}
+
+// The one place the try_ methods catch: transport timeouts and malformed
+// replies surface as exceptions from the layers below. A status reply
+// other than OK is returned as ERR_DEVICE.
+ell_expected<ell_response> elliptec::try_exchange(const std::string &addr, const std::string &msg, bool motion, bool needs_home) {
+    ell_response ret;
+    try {
+        if (motion) {
+            motion_scope scope(*this, addr, needs_home);
+            motion_write(msg);
+            ret = motion_response();
+        } else {
+            write(msg);
+            ret = process_response();
+        }
+    } catch (timeout_exception &ex) {
+        return fail(ERR_TIMEOUT, addr, ex.what());
+    } catch (std::exception &ex) {
+        return fail(ERR_PARSE, addr, ex.what());
+    }
+    if (!ret.type.compare("GS") && (ret.data.length() >= 2)) {
+        uint8_t code = std::stoi(ret.data.substr(0,2), nullptr, 16);
+        if (code != OK) {
+            return fail(ERR_DEVICE, addr, err2string(code), code);
+        }
+    }
+    return ret;
+}
+
+ell_expected<uint8_t> elliptec::try_get_status(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto ret = try_exchange(addr, addr + "gs", false);
+    if (!ret) {
+        if (ret.error().kind == ERR_DEVICE) {
+            return ret.error().code;
+        }
+        return ell_unexpected(ret.error());
+    }
+    if (ret->type.compare("GS")) {
+        return fail(ERR_PARSE, addr, "expected GS, got " + ret->type + ret->data);
+    }
+    return OK;
+}
+
+// position reached by a motion or reported by gp, in deg or mm
+ell_expected<double> elliptec::try_position_reply(const std::string &addr, const ell_expected<ell_response> &ret) {
+    if (!ret) {
+        return ell_unexpected(ret.error());
+    }
+    if (ret->type.compare("PO")) {
+        return fail(ERR_PARSE, addr, "expected PO, got " + ret->type + ret->data);
+    }
+    int64_t step = hex2step(ret->data);
+    return devislinear(addr) ? step2mm(addr, step) : step2deg(addr, step);
+}
+
+ell_expected<double> elliptec::try_get_position(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto dev = try_device(addr);
+    if (!dev) {
+        return ell_unexpected(dev.error());
+    }
+    if (!devintype("linrot", dev->type)) {
+        return fail(ERR_INVALID, addr, "Only linear and rotary devices report a position");
+    }
+    return try_position_reply(addr, try_exchange(addr, addr + "gp", false));
+}
+
+std::vector<ell_expected<double>> elliptec::try_get_positions(const std::vector<std::string> &addrs) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::vector<ell_expected<double>> positions;
+    positions.reserve(addrs.size());
+    for (const std::string &addr : addrs) {
+        positions.push_back(try_get_position(addr));
+    }
+    return positions;
+}
+
+// One query to every address without waiting for each reply. Devices
+// share the return line, so each write follows the previous one by a reply
+// length and its reply starts as that one ends.
+// Replies are matched by address in whatever order they come. The reader
+// thread only hands out replies of the address last written to; with it
+// running the devices are asked one after the other.
+std::unordered_map<std::string, ell_expected<ell_response>> elliptec::try_broadcast(const std::vector<std::string> &addrs, const std::string &cmd, size_t reply_chars) {
+    std::unordered_map<std::string, ell_expected<ell_response>> replies;
+    if (_reader_running) {
+        for (const std::string &addr : addrs) {
+            replies.emplace(addr, try_exchange(addr, addr + cmd, false));
+        }
+        return replies;
+    }
+    using std::chrono::steady_clock;
+    const auto spacing = std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>((reply_chars + BROADCAST_GAP_CHARS)*CHAR_TIME));
+    auto next = steady_clock::now();
+    for (const std::string &addr : addrs) {
+        std::this_thread::sleep_until(next);
+        next = steady_clock::now() + spacing;
+        write(addr + cmd);
+    }
+
+    std::vector<std::string> pending = addrs;
+    auto deadline = bserial->deadline();
+    while (!pending.empty()) {
+        std::string response;
+        try {
+            response = bserial->read_frame(deadline);
+        } catch (timeout_exception &ex) {
+            for (const std::string &addr : pending) {
+                replies.emplace(addr, fail(ERR_TIMEOUT, addr, ex.what()));
+            }
+            break;
+        }
+        auto it = std::find(pending.begin(), pending.end(), response.substr(0,1));
+        if (it == pending.end()) {
+            route_stray(response);
+            continue;
+        }
+        const std::string addr = *it;
+        if (!_background_io && !_quiet) {
+            std::cout << "got response " << response << std::endl;
+        }
+        try {
+            uint8_t code = parsestatus(response);
+            if (code != OK) {
+                replies.emplace(addr, fail(ERR_DEVICE, addr, err2string(code), code));
+            } else {
+                replies.emplace(addr, process_response(response));
+            }
+        } catch (std::exception &ex) {
+            replies.emplace(addr, fail(ERR_PARSE, addr, ex.what()));
+        }
+        pending.erase(it);
+    }
+    return replies;
+}
+
+// Every linear and rotary stage gets ms back to back, so the last one
+// stops a few frame times after the first. Their replies overlap on the
+// return line and are dropped; where each one stopped is asked for with
+// gp afterwards. Running maintenance is interrupted first.
+// A stage still decelerating sends its position once at rest, which would
+// collide with the gp sweep or be taken as its answer. gs is asked until
+// none reports busy, and the line is cleared before gp.
+std::unordered_map<std::string, ell_expected<double>> elliptec::try_stop_all() {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::vector<std::string> addrs;
+    for (const ell_device &dev : devices) {
+        if (devintype("linrot", dev.type)) {
+            preempt_jobs(dev.address);
+            addrs.push_back(dev.address);
+        }
+    }
+    for (const std::string &addr : addrs) {
+        write(addr + "ms");
+    }
+    size_t chars = addrs.size()*STOP_FRAME_CHARS + STOP_REPLY_CHARS;
+    std::this_thread::sleep_for(std::chrono::duration<double>(chars*CHAR_TIME) + std::chrono::milliseconds(SCAN_MARGIN_MS));
+    if (!_reader_running) {
+        bserial->flush();
+    }
+
+    {
+        quiet_scope quiet(*this);
+        std::vector<std::string> moving = addrs;
+        auto settle = std::chrono::steady_clock::now() + std::chrono::milliseconds(STOP_SETTLE_MS);
+        while (!moving.empty()) {
+            std::vector<std::string> busy;
+            //a late position reply may answer gs; it means the stage is at rest
+            for (const auto &[addr, ret] : try_broadcast(moving, "gs", STOP_REPLY_CHARS)) {
+                if (!ret && (ret.error().kind == ERR_DEVICE) && (ret.error().code == BUSY)) {
+                    busy.push_back(addr);
+                }
+            }
+            moving = busy;
+            if (!moving.empty()) {
+                if (std::chrono::steady_clock::now() >= settle) {
+                    std::cout << "stop all: " << moving.size() << " stages still busy" << std::endl;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(STOP_POLL_MS));
+            }
+        }
+    }
+    //the gs replies that came after a late position reply
+    std::this_thread::sleep_for(std::chrono::duration<double>(STATUS_REPLY_CHARS*CHAR_TIME) + std::chrono::milliseconds(SCAN_MARGIN_MS));
+    if (!_reader_running) {
+        bserial->flush();
+    }
+    _last_motion = std::chrono::steady_clock::now();
+
+    std::unordered_map<std::string, ell_expected<double>> positions;
+    for (const auto &[addr, ret] : try_broadcast(addrs, "gp", STOP_REPLY_CHARS)) {
+        positions.emplace(addr, try_position_reply(addr, ret));
+    }
+    return positions;
+}
+
+std::unordered_map<std::string, ell_expected<uint8_t>> elliptec::try_status_all() {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    std::vector<std::string> addrs;
+    for (const ell_device &dev : devices) {
+        addrs.push_back(dev.address);
+    }
+    std::unordered_map<std::string, ell_expected<uint8_t>> status;
+    for (const auto &[addr, ret] : try_broadcast(addrs, "gs", STATUS_REPLY_CHARS)) {
+        if (!ret) {
+            if (ret.error().kind == ERR_DEVICE) {
+                status.emplace(addr, ret.error().code);
+            } else {
+                status.emplace(addr, ell_unexpected(ret.error()));
+            }
+        } else if (ret->type.compare("GS")) {
+            status.emplace(addr, fail(ERR_PARSE, addr, "expected GS, got " + ret->type + ret->data));
+        } else {
+            status.emplace(addr, uint8_t(OK));
+        }
+    }
+    return status;
+}
+
+ell_expected<double> elliptec::try_move_to(const std::string &addr, const std::string &cmd, int64_t target) {
+    auto dev = try_device(addr);
+    if (!dev) {
+        return ell_unexpected(dev.error());
+    }
+    if (!devintype("linrot", dev->type)) {
+        return fail(ERR_INVALID, addr, "Only linear and rotary devices support " + cmd);
+    }
+    const bool linear = devintype("linear", dev->type);
+    int64_t delta = target;
+    if (!cmd.compare("mr")) {
+        //lazy homing moves the stage, the distance counts from where it ends
+        if (std::find(_needs_home.begin(), _needs_home.end(), addr) != _needs_home.end()) {
+            auto homed = try_home(addr);
+            if (!homed) {
+                return ell_unexpected(homed.error());
+            }
+        }
+        if (_positions.find(addr) == _positions.end()) {
+            auto pos = try_exchange(addr, addr + "gp", false);
+            if (!pos) {
+                return ell_unexpected(pos.error());
+            }
+        }
+        target += _positions[addr];
+    }
+    auto reached = try_position_reply(addr, try_exchange(addr, addr + cmd + step2hex(delta), true, true));
+    if (!reached) {
+        return reached;
+    }
+    double want = linear ? step2mm(addr, target) : step2deg(addr, target);
+    if (std::abs(*reached - want) > (linear ? MMERR : DEGERR)) {
+        return fail(ERR_MISSED, addr, "moved to " + std::to_string(*reached) + " while trying to move to " + std::to_string(want));
+    }
+    return reached;
+}
+
+ell_expected<double> elliptec::try_move_absolute(std::string addr, double pos) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto dev = try_device(addr);
+    if (!dev) {
+        return ell_unexpected(dev.error());
+    }
+    int64_t step = devintype("linear", dev->type) ? mm2step(addr, pos) : deg2step(addr, pos);
+    return try_move_to(addr, "ma", step);
+}
+
+ell_expected<double> elliptec::try_move_relative(std::string addr, double pos) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto dev = try_device(addr);
+    if (!dev) {
+        return ell_unexpected(dev.error());
+    }
+    int64_t step = devintype("linear", dev->type) ? mm2step(addr, pos) : deg2step(addr, pos);
+    return try_move_to(addr, "mr", step);
+}
+
+ell_expected<double> elliptec::try_home(std::string addr, std::string dir) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto dev = try_device(addr);
+    if (!dev) {
+        return ell_unexpected(dev.error());
+    }
+    if (!devintype("linrot", dev->type)) {
+        return fail(ERR_INVALID, addr, "Only linear and rotary devices report a home position");
+    }
+    std::erase(_needs_home, addr);
+    return try_position_reply(addr, try_exchange(addr, addr + "ho" + dir, true));
+}
+
+ell_expected<uint8_t> elliptec::try_get_velocity(std::string addr) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    auto ret = try_exchange(addr, addr + "gv", false);
+    if (!ret) {
+        return ell_unexpected(ret.error());
+    }
+    if (ret->type.compare("GV") || (ret->data.length() < 2)) {
+        return fail(ERR_PARSE, addr, "expected GV, got " + ret->type + ret->data);
+    }
+    uint8_t percent = std::stoi(ret->data.substr(0,2), nullptr, 16);
+    cache_setting(addr, "gv", "GV" + uc2hex(percent));
+    return percent;
+}
+
+ell_expected<void> elliptec::try_set_velocity(std::string addr, uint8_t percent) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    if (percent > 100) {
+        return fail(ERR_INVALID, addr, "velocity has to be 0...100 %");
+    }
+    auto ret = try_exchange(addr, addr + "sv" + uc2hex(percent), false);
+    if (!ret) {
+        return ell_unexpected(ret.error());
+    }
+    cache_setting(addr, "gv", "GV" + uc2hex(percent));
+    return {};
+}
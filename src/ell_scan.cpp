@@ -0,0 +1,64 @@
+#include "ell.h"
+
+/*****************************************
+ *
+ * Jog scan
+ *
+ *****************************************/
+// Every point is a 3 byte fw/bw frame instead of an 11 byte ma. Targets
+// are kept in whole steps, so the only drift is the device's own motion
+// error; once the reported position is further than DEGERR/MMERR from the
+// target an absolute move puts it back. The jog step is left at step.
+size_t elliptec::jog_scan(std::string addr, double start, double step, size_t count, std::function<bool(const ell_scan_point&)> on_point) {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    motion_scope motion(*this, addr, true);
+    if (!devislinrot(addr)) {
+        throw std::invalid_argument("Only linear and rotary devices support jog scans");
+    }
+    const bool linear = devislinear(addr);
+    const uint64_t pulses = devinfo_at_addr(addr)->pulses;
+    const MillimeterConverter mm(pulses);
+    const DegreeConverter deg(pulses);
+    auto to_steps = [&](double v) { return (linear ? mm.to_steps(Millimeters(v)) : deg.to_steps(Degrees(v))).value; };
+    auto from_steps = [&](int64_t s) { return linear ? mm.to_units(Steps(s)).value : deg.to_units(Steps(s)).value; };
+    const int64_t jog = to_steps(step);
+    if (jog == 0) {
+        throw std::invalid_argument("scan step is below one device step");
+    }
+    const int64_t tolerance = std::max<int64_t>(1, to_steps(linear ? MMERR : DEGERR));
+    const int64_t first = to_steps(start);
+    const std::string advance = addr + ((jog > 0) ? "fw" : "bw");
+
+    quiet_scope quiet(*this);
+    set_jogstep_size(addr, std::abs(step));
+    size_t done = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int64_t target = first + int64_t(i)*jog;
+        ell_scan_point pt;
+        pt.index = i;
+        pt.target = from_steps(target);
+        if (i == 0) {
+            motion_write(addr + "ma" + step2hex(target));
+        } else {
+            motion_write(advance);
+        }
+        ell_response ret = motion_response();
+        for (uint8_t retry = 0; ; ++retry) {
+            if (!ret.type.compare("PO") && (std::llabs(hex2step(ret.data) - target) <= tolerance)) {
+                break;
+            }
+            if (retry == 5) {
+                throw std::runtime_error("scan point " + std::to_string(i) + " not reached, reply " + ret.type + ret.data);
+            }
+            pt.corrected = true;
+            motion_write(addr + "ma" + step2hex(target));
+            ret = motion_response();
+        }
+        pt.position = from_steps(hex2step(ret.data));
+        ++done;
+        if (on_point && !on_point(pt)) {
+            break;
+        }
+    }
+    return done;
+}
@@ -0,0 +1,101 @@
+#include "ell.h"
+
+#include <filesystem>
+#include <fstream>
+
+/*****************************************
+ *
+ * Startup state
+ *
+ *****************************************/
+ell_home_policy home_policy_from_string(const std::string &name) {
+    if (!name.compare("always")) {
+        return HOME_ALWAYS;
+    } else if (!name.compare("if-needed")) {
+        return HOME_IF_NEEDED;
+    } else if (!name.compare("lazy")) {
+        return HOME_LAZY;
+    } else if (!name.compare("never")) {
+        return HOME_NEVER;
+    }
+    throw std::invalid_argument("unknown home policy " + name);
+}
+
+// State file: one "<serial> <position in steps>" line per device, keyed by
+// serial number so that readdressed devices keep their entry.
+std::unordered_map<uint64_t, int64_t> elliptec::load_state() {
+    std::unordered_map<uint64_t, int64_t> saved;
+    if (_state_path == "") {
+        return saved;
+    }
+    std::ifstream in(_state_path);
+    uint64_t serial;
+    int64_t step;
+    while (in >> serial >> step) {
+        saved[serial] = step;
+    }
+    return saved;
+}
+
+void elliptec::save_state() {
+    std::lock_guard<std::recursive_mutex> lock(_busmtx);
+    if (_state_path == "") {
+        throw std::invalid_argument("no state file configured");
+    }
+    std::unordered_map<uint64_t, int64_t> saved = load_state();
+    for (const ell_device &dev : devices) {
+        if (std::find(_needs_home.begin(), _needs_home.end(), dev.address) != _needs_home.end()) {
+            saved.erase(dev.serial);
+        } else if (_positions.count(dev.address)) {
+            saved[dev.serial] = _positions[dev.address];
+        }
+    }
+
+    std::string tmp = _state_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const auto &[serial, step] : saved) {
+            out << serial << " " << step << "\n";
+        }
+        if (!out) {
+            throw std::runtime_error("cannot write state file " + tmp);
+        }
+    }
+    std::filesystem::rename(tmp, _state_path);
+}
+
+// A device keeps its position counter across sessions but restarts at zero
+// after a power cycle. Its position is trusted if it reports no error and
+// the counter still matches the last persisted value within DEGERR/MMERR.
+// Devices without a position readout (paddles, piezos) only need a clean
+// status.
+bool elliptec::position_trusted(std::string addr, const std::unordered_map<uint64_t, int64_t> &saved) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    if (get_status(addr) != OK) {
+        power_cycled(addr);
+        return false;
+    }
+    if (!devislinrot(addr)) {
+        return true;
+    }
+    get_position(addr);
+    auto it = saved.find(dev.value().serial);
+    if ((it == saved.end()) || !_positions.count(addr)) {
+        return false;
+    }
+    int64_t tolerance = devisrotary(addr) ? deg2step(addr, DEGERR) : mm2step(addr, MMERR);
+    if (std::abs(_positions[addr] - it->second) > std::max<int64_t>(tolerance, 1)) {
+        power_cycled(addr);
+        return false;
+    }
+    return true;
+}
+
+void elliptec::ensure_homed(std::string addr) {
+    if (std::find(_needs_home.begin(), _needs_home.end(), addr) != _needs_home.end()) {
+        home(addr);
+    }
+}
@@ -0,0 +1,467 @@
+#include "ell_transport.h"
+#include "ell_emulator.h"
+#include "posix_serial.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+static const std::string FRAME_END = "\r\n";
+
+/*****************************************
+ *
+ * ell_transport
+ *
+ *****************************************/
+void ell_transport::setTimeout(const boost::posix_time::time_duration &t) {
+    _timeout_ms = t.total_milliseconds();
+}
+
+ell_transport::clock::time_point ell_transport::deadline() const {
+    if (_timeout_ms <= 0) {
+        return clock::time_point::max();
+    }
+    return clock::now() + std::chrono::milliseconds(_timeout_ms);
+}
+
+bool ell_transport::concurrent_io() const {
+    return true;
+}
+
+std::string ell_transport::next_frame() {
+    return read_frame(deadline());
+}
+
+size_t ell_transport::next_frames(std::vector<std::string_view> &frames) {
+    return read_frames(frames, deadline());
+}
+
+size_t ell_transport::read_frames(std::vector<std::string_view> &frames, clock::time_point deadline) {
+    _batch = read_frame(deadline);
+    frames.push_back(_batch);
+    return 1;
+}
+
+bool ell_transport::rx_started(clock::time_point) {
+    return true;
+}
+
+bool ell_transport::detects_rx_start() const {
+    return false;
+}
+
+/*****************************************
+ *
+ * boost_transport
+ *
+ *****************************************/
+void boost_transport::open(const std::string &devname, unsigned int baud_rate) {
+    _port.open(devname, baud_rate,
+               boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
+               boost::asio::serial_port_base::character_size(8),
+               boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none),
+               boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one));
+}
+
+bool boost_transport::isOpen() const {
+    return _port.isOpen();
+}
+
+void boost_transport::close() {
+    _port.close();
+}
+
+void boost_transport::write_frame(std::string_view frame) {
+    _port.write(frame.data(), frame.size());
+}
+
+std::string boost_transport::read_frame(clock::time_point deadline) {
+    while (true) {
+        if (_cancel.exchange(false)) {
+            throw timeout_exception("Read cancelled");
+        }
+        long slice = CANCEL_POLL_MS;
+        if (deadline != clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+            if (left <= 0) {
+                throw timeout_exception("Timeout expired");
+            }
+            slice = std::min(slice, long(left));
+        }
+        _port.setTimeout(boost::posix_time::milliseconds(slice));
+        try {
+            return _port.readStringUntil(FRAME_END);
+        } catch (timeout_exception &) {
+        }
+    }
+}
+
+void boost_transport::cancel() {
+    _cancel = true;
+}
+
+void boost_transport::clear_cancel() {
+    _cancel = false;
+}
+
+void boost_transport::flush() {
+    _port.flush();
+}
+
+// asio does not allow a synchronous write while an asynchronous read is
+// outstanding on the same port
+bool boost_transport::concurrent_io() const {
+    return false;
+}
+
+/*****************************************
+ *
+ * fd_transport
+ *
+ *****************************************/
+static std::system_error errno_error(const std::string &what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+fd_transport::fd_transport() {
+    _cancelfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_cancelfd < 0) {
+        throw errno_error("eventfd");
+    }
+}
+
+fd_transport::~fd_transport() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+    ::close(_cancelfd);
+}
+
+void fd_transport::adopt(int fd) {
+    _fd = fd;
+    _rx.clear();
+}
+
+bool fd_transport::isOpen() const {
+    return _fd >= 0;
+}
+
+void fd_transport::close() {
+    if (_fd < 0) {
+        return;
+    }
+    int fd = _fd;
+    _fd = -1;
+    _rx.clear();
+    if (::close(fd) != 0) {
+        throw errno_error("close");
+    }
+}
+
+void fd_transport::write_frame(std::string_view frame) {
+    size_t done = 0;
+    while (done < frame.size()) {
+        ssize_t n = ::write(_fd, frame.data() + done, frame.size() - done);
+        if (n >= 0) {
+            done += n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            throw errno_error("write");
+        }
+        pollfd p = {_fd, POLLOUT, 0};
+        if ((poll(&p, 1, -1) < 0) && (errno != EINTR)) {
+            throw errno_error("poll");
+        }
+    }
+}
+
+void fd_transport::drain_cancel() {
+    uint64_t count;
+    while (::read(_cancelfd, &count, sizeof(count)) > 0) {
+    }
+}
+
+// one read() into the ring, after waiting for data until deadline
+void fd_transport::fill(clock::time_point deadline) {
+    while (true) {
+        int wait = -1;
+        if (deadline != clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+            if (left <= 0) {
+                throw timeout_exception("Timeout expired");
+            }
+            wait = int(std::min<long>(left, INT_MAX));
+        }
+        pollfd p[2] = {{_fd, POLLIN, 0}, {_cancelfd, POLLIN, 0}};
+        int r = poll(p, 2, wait);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw errno_error("poll");
+        }
+        if (p[1].revents & POLLIN) {
+            drain_cancel();
+            throw timeout_exception("Read cancelled");
+        }
+        if (r == 0) {
+            continue;
+        }
+        std::span<char> space = _rx.prepare();
+        ssize_t n = ::read(_fd, space.data(), space.size());
+        if (n > 0) {
+            _rx.commit(n);
+            return;
+        } else if (n == 0) {
+            throw std::runtime_error("connection to controller closed");
+        } else if ((errno != EAGAIN) && (errno != EINTR)) {
+            throw errno_error("read");
+        }
+    }
+}
+
+std::string fd_transport::read_frame(clock::time_point deadline) {
+    std::string_view frame;
+    while (!_rx.next(frame)) {
+        fill(deadline);
+    }
+    return std::string(frame);
+}
+
+size_t fd_transport::read_frames(std::vector<std::string_view> &frames, clock::time_point deadline) {
+    size_t n = _rx.drain(frames);
+    while (n == 0) {
+        fill(deadline);
+        n = _rx.drain(frames);
+    }
+    return n;
+}
+
+bool fd_transport::rx_started(clock::time_point deadline) {
+    if (_rx.pending() > 0) {
+        return true;
+    }
+    try {
+        fill(deadline);
+    } catch (timeout_exception &) {
+        return false;
+    }
+    return true;
+}
+
+bool fd_transport::detects_rx_start() const {
+    return true;
+}
+
+void fd_transport::cancel() {
+    uint64_t one = 1;
+    if (::write(_cancelfd, &one, sizeof(one)) < 0) {
+        // counter saturated: a cancel is pending anyway
+    }
+}
+
+void fd_transport::clear_cancel() {
+    drain_cancel();
+}
+
+void fd_transport::flush() {
+    _rx.clear();
+    if (_fd < 0) {
+        return;
+    }
+    std::span<char> space = _rx.prepare();
+    while (::read(_fd, space.data(), space.size()) > 0) {
+    }
+}
+
+/*****************************************
+ *
+ * tcp_transport
+ *
+ *****************************************/
+void tcp_transport::open(const std::string &devname, unsigned int) {
+    if (isOpen()) {
+        close();
+    }
+    size_t colon = devname.find_last_of(':');
+    if ((colon == std::string::npos) || (colon == 0) || (colon + 1 == devname.length())) {
+        throw std::invalid_argument("tcp device has to be host:port, got " + devname);
+    }
+    std::string host = devname.substr(0, colon);
+    std::string port = devname.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *res = nullptr;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0) {
+        throw std::runtime_error("cannot resolve " + devname + ": " + gai_strerror(err));
+    }
+    int fd = -1;
+    for (addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        throw errno_error("cannot connect to " + devname);
+    }
+    // commands are a few bytes each, send them without coalescing
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    adopt(fd);
+}
+
+/*****************************************
+ *
+ * loopback_transport
+ *
+ *****************************************/
+loopback_transport::loopback_transport() = default;
+
+loopback_transport::~loopback_transport() = default;
+
+void loopback_transport::open(const std::string &devname, unsigned int) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _emu = std::make_unique<ell_emulator>(devname);
+    _frames.clear();
+}
+
+bool loopback_transport::isOpen() const {
+    return _emu != nullptr;
+}
+
+void loopback_transport::close() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _emu.reset();
+    _frames.clear();
+}
+
+void loopback_transport::write_frame(std::string_view frame) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_emu) {
+        throw std::runtime_error("loopback transport not open");
+    }
+    _emu->feed(frame, _frames);
+    _cv.notify_all();
+}
+
+void loopback_transport::wait(std::unique_lock<std::mutex> &lock, clock::time_point deadline) {
+    auto ready = [this] { return !_frames.empty() || _cancel; };
+    if (deadline == clock::time_point::max()) {
+        _cv.wait(lock, ready);
+    } else if (!_cv.wait_until(lock, deadline, ready)) {
+        throw timeout_exception("Timeout expired");
+    }
+    if (_frames.empty()) {
+        _cancel = false;
+        throw timeout_exception("Read cancelled");
+    }
+}
+
+std::string loopback_transport::read_frame(clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    wait(lock, deadline);
+    std::string frame = std::move(_frames.front());
+    _frames.pop_front();
+    return frame;
+}
+
+size_t loopback_transport::read_frames(std::vector<std::string_view> &frames, clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    wait(lock, deadline);
+    _batch.assign(std::make_move_iterator(_frames.begin()), std::make_move_iterator(_frames.end()));
+    _frames.clear();
+    for (const std::string &f : _batch) {
+        frames.push_back(f);
+    }
+    return _batch.size();
+}
+
+bool loopback_transport::rx_started(clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    try {
+        wait(lock, deadline);
+    } catch (timeout_exception &) {
+        return false;
+    }
+    return true;
+}
+
+bool loopback_transport::detects_rx_start() const {
+    return true;
+}
+
+void loopback_transport::cancel() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _cancel = true;
+    _cv.notify_all();
+}
+
+void loopback_transport::clear_cancel() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _cancel = false;
+}
+
+void loopback_transport::flush() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _frames.clear();
+}
+
+ell_emulator *loopback_transport::emulator() {
+    return _emu.get();
+}
+
+/*****************************************
+ *
+ * Selection
+ *
+ *****************************************/
+ell_transport_kind transport_kind_from_string(const std::string &name) {
+    if (!name.compare("boost")) {
+        return TRANSPORT_BOOST;
+    } else if (!name.compare("posix")) {
+        return TRANSPORT_POSIX;
+    } else if (!name.compare("tcp")) {
+        return TRANSPORT_TCP;
+    } else if (!name.compare("loopback")) {
+        return TRANSPORT_LOOPBACK;
+    }
+    throw std::invalid_argument("unknown transport " + name);
+}
+
+std::unique_ptr<ell_transport> make_transport(const ell_transport_config &cfg) {
+    switch (cfg.kind) {
+        case TRANSPORT_BOOST:
+            return std::make_unique<boost_transport>();
+        case TRANSPORT_POSIX:
+            return std::make_unique<Posix_serial>(cfg.low_latency, cfg.ftdi_latency_ms);
+        case TRANSPORT_TCP:
+            return std::make_unique<tcp_transport>();
+        case TRANSPORT_LOOPBACK:
+            return std::make_unique<loopback_transport>();
+    }
+    throw std::invalid_argument("unknown transport kind " + std::to_string(cfg.kind));
+}
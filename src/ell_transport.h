@@ -0,0 +1,255 @@
+#ifndef ELL_TRANSPORT_H
+#define ELL_TRANSPORT_H
+
+/*! \file */
+
+#include "boost_serial.h"
+#include "ell_frame_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum ell_transport_kind {
+    TRANSPORT_BOOST = 0,    //Boost_serial, asio based
+    TRANSPORT_POSIX = 1,    //Posix_serial, raw termios and poll
+    TRANSPORT_TCP = 2,      //TCP stream to a serial server, devname is host:port
+    TRANSPORT_LOOPBACK = 3  //in-process ell_emulator, devname lists addr:type pairs
+};
+
+// "boost", "posix", "tcp" or "loopback"
+ell_transport_kind transport_kind_from_string(const std::string &name);
+
+struct ell_transport_config {
+    ell_transport_kind kind = TRANSPORT_BOOST;
+    bool low_latency = true;        //set ASYNC_LOW_LATENCY on the tty, posix only
+    int ftdi_latency_ms = 1;        //FTDI latency_timer via sysfs, posix only, <= 0 leaves it alone
+};
+
+/*
+ * Frame stream to the controller. Commands are written as they are, replies
+ * are read one "\r\n" terminated frame at a time. Everything but cancel()
+ * is called with the bus held; cancel() may be called from any thread.
+ */
+class ell_transport {
+public:
+    using clock = std::chrono::steady_clock;
+
+    virtual ~ell_transport() = default;
+
+    /**
+     * Opens the device at 8N1 without flow control.
+     * \throws std::exception if the device cannot be opened
+     */
+    virtual void open(const std::string &devname, unsigned int baud_rate) = 0;
+    virtual bool isOpen() const = 0;
+    virtual void close() = 0;
+
+    virtual void write_frame(std::string_view frame) = 0;
+
+    /**
+     * Read one frame, without its terminator. clock::time_point::max()
+     * waits forever.
+     * \throws timeout_exception if the deadline passes or the read is cancelled
+     */
+    virtual std::string read_frame(clock::time_point deadline) = 0;
+
+    /**
+     * Wait for at least one frame, then append every frame received so far
+     * to frames. The views stay valid until the next read on the transport.
+     * \return number of frames appended
+     * \throws timeout_exception if the deadline passes or the read is cancelled
+     */
+    virtual size_t read_frames(std::vector<std::string_view> &frames, clock::time_point deadline);
+
+    /**
+     * Wait until reply bytes arrive, before their frame is complete.
+     * \return false if nothing arrived by the deadline or the wait was
+     * cancelled. Transports that cannot tell return true at once.
+     */
+    virtual bool rx_started(clock::time_point deadline);
+
+    /**
+     * \return whether rx_started() actually waits for reply bytes
+     */
+    virtual bool detects_rx_start() const;
+
+    /**
+     * Aborts a read_frame() blocked in another thread. With no read blocked
+     * the next one is aborted, so a cancel just before the read is not lost.
+     */
+    virtual void cancel() = 0;
+
+    /**
+     * Drops a cancel() no read has taken. Called by the cancelling thread
+     * once it holds the bus, when the read it aimed at is over.
+     */
+    virtual void clear_cancel() = 0;
+
+    /**
+     * Discards everything received but not yet read.
+     */
+    virtual void flush() = 0;
+
+    /**
+     * \return whether read_frame() may block in one thread while another
+     * writes, as the reader thread of elliptec does
+     */
+    virtual bool concurrent_io() const;
+
+    /**
+     * Set the timeout used by next_frame(). seconds(0) disables it.
+     */
+    void setTimeout(const boost::posix_time::time_duration &t);
+
+    /**
+     * \return now plus the timeout, clock::time_point::max() if disabled
+     */
+    clock::time_point deadline() const;
+
+    /**
+     * read_frame() with a deadline of now plus the timeout.
+     */
+    std::string next_frame();
+
+    /**
+     * read_frames() with a deadline of now plus the timeout.
+     */
+    size_t next_frames(std::vector<std::string_view> &frames);
+
+protected:
+    long _timeout_ms = 0;           //0 waits forever
+
+private:
+    std::string _batch;             //backs the view of the default read_frames()
+};
+
+/*
+ * ell_transport on top of Boost_serial. Boost_serial cannot be interrupted
+ * from another thread, so reads wait in slices of CANCEL_POLL_MS and check
+ * for cancel() in between.
+ */
+class boost_transport : public ell_transport {
+public:
+    void open(const std::string &devname, unsigned int baud_rate) override;
+    bool isOpen() const override;
+    void close() override;
+    void write_frame(std::string_view frame) override;
+    std::string read_frame(clock::time_point deadline) override;
+    void cancel() override;
+    void clear_cancel() override;
+    void flush() override;
+    bool concurrent_io() const override;
+
+private:
+    static constexpr long CANCEL_POLL_MS = 50;
+    Boost_serial _port;
+    std::atomic<bool> _cancel{false};
+};
+
+/*
+ * Frame reading on a non-blocking file descriptor with poll(). Each read()
+ * goes straight into an ell_frame_ring and takes whatever the driver has
+ * buffered, so back-to-back replies cost one syscall. cancel() signals an
+ * eventfd polled alongside the descriptor.
+ */
+class fd_transport : public ell_transport {
+public:
+    fd_transport();
+    ~fd_transport() override;
+    fd_transport(const fd_transport &) = delete;
+    fd_transport &operator=(const fd_transport &) = delete;
+
+    bool isOpen() const override;
+    void close() override;
+    void write_frame(std::string_view frame) override;
+    std::string read_frame(clock::time_point deadline) override;
+    size_t read_frames(std::vector<std::string_view> &frames, clock::time_point deadline) override;
+    bool rx_started(clock::time_point deadline) override;
+    bool detects_rx_start() const override;
+    void cancel() override;
+    void clear_cancel() override;
+    void flush() override;
+
+protected:
+    int _fd = -1;
+    ell_frame_ring _rx;             //received, not yet consumed
+
+    void adopt(int fd);
+
+private:
+    int _cancelfd = -1;
+
+    void drain_cancel();
+    void fill(clock::time_point deadline);
+};
+
+/*
+ * TCP stream to a serial-to-network server (ser2net and the like), for
+ * controllers on another machine or emulators in another process.
+ */
+class tcp_transport : public fd_transport {
+public:
+    /**
+     * \param devname host:port
+     * \param baud_rate ignored, the server sets the line speed
+     */
+    void open(const std::string &devname, unsigned int baud_rate) override;
+};
+
+class ell_emulator;
+
+/*
+ * In-process transport connected to an ell_emulator. Replies are available
+ * as soon as the command is written, so timing a command measures only the
+ * library's own overhead.
+ */
+class loopback_transport : public ell_transport {
+public:
+    loopback_transport();
+    ~loopback_transport() override;
+
+    /**
+     * \param devname emulated devices, see ell_emulator
+     * \param baud_rate ignored
+     */
+    void open(const std::string &devname, unsigned int baud_rate) override;
+    bool isOpen() const override;
+    void close() override;
+    void write_frame(std::string_view frame) override;
+    std::string read_frame(clock::time_point deadline) override;
+    size_t read_frames(std::vector<std::string_view> &frames, clock::time_point deadline) override;
+    bool rx_started(clock::time_point deadline) override;
+    bool detects_rx_start() const override;
+    void cancel() override;
+    void clear_cancel() override;
+    void flush() override;
+
+    /**
+     * \return the emulator, nullptr while closed
+     */
+    ell_emulator *emulator();
+
+private:
+    std::unique_ptr<ell_emulator> _emu;
+    std::deque<std::string> _frames;
+    std::vector<std::string> _batch;    //backs the views of read_frames()
+    bool _cancel = false;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+
+    void wait(std::unique_lock<std::mutex> &lock, clock::time_point deadline);
+};
+
+/**
+ * Creates an unopened transport of the configured kind.
+ */
+std::unique_ptr<ell_transport> make_transport(const ell_transport_config &cfg);
+
+#endif // ELL_TRANSPORT_H
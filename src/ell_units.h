@@ -0,0 +1,112 @@
+#ifndef ELL_UNITS_H
+#define ELL_UNITS_H
+
+/*! \file */
+
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Positions and distances with their unit in the type. Steps are the
+ * device's encoder pulses and always signed; Degrees and Millimeters are
+ * what the user works in. Converting between them needs the device, see
+ * ell_converter.
+ */
+template <class Tag, class Rep>
+struct ell_quantity {
+    Rep value = 0;
+
+    constexpr ell_quantity() = default;
+    constexpr explicit ell_quantity(Rep v) : value(v) {}
+
+    constexpr ell_quantity operator+(ell_quantity o) const { return ell_quantity(value + o.value); }
+    constexpr ell_quantity operator-(ell_quantity o) const { return ell_quantity(value - o.value); }
+    constexpr ell_quantity operator-() const { return ell_quantity(-value); }
+    constexpr ell_quantity operator*(Rep k) const { return ell_quantity(value*k); }
+    constexpr ell_quantity &operator+=(ell_quantity o) { value += o.value; return *this; }
+    constexpr ell_quantity &operator-=(ell_quantity o) { value -= o.value; return *this; }
+    constexpr auto operator<=>(const ell_quantity &) const = default;
+};
+
+struct ell_steps_tag {};
+struct ell_degrees_tag {};
+struct ell_millimeters_tag {};
+
+using Steps = ell_quantity<ell_steps_tag, int64_t>;
+using Degrees = ell_quantity<ell_degrees_tag, double>;
+using Millimeters = ell_quantity<ell_millimeters_tag, double>;
+
+/*
+ * Conversion between Steps and Unit for one device, made once from
+ * ell_device::pulses (per revolution for Degrees, per mm for Millimeters).
+ * The factor is kept as a reduced fraction num/den: a value is scaled by
+ * the integer num before the division, so whole units convert without
+ * error and each conversion rounds once, half away from zero. Converting
+ * steps to units and back always gives the same steps.
+ */
+template <class Unit>
+class ell_converter {
+public:
+    static_assert(std::is_same_v<Unit, Degrees> || std::is_same_v<Unit, Millimeters>, "Degrees or Millimeters");
+
+    constexpr ell_converter() = default;
+    explicit constexpr ell_converter(uint64_t pulses) {
+        if (pulses == 0) {
+            throw std::invalid_argument("device reports 0 pulses per unit");
+        }
+        int64_t per = std::is_same_v<Unit, Degrees> ? 360 : 1;
+        int64_t g = std::gcd(int64_t(pulses), per);
+        _num = int64_t(pulses)/g;
+        _den = per/g;
+    }
+
+    Steps to_steps(Unit u) const { return Steps(std::llround(u.value*_num/_den)); }
+    Unit to_units(Steps s) const { return Unit(double(s.value)*_den/_num); }
+
+    // bulk conversion for scan tables, in and out have the same size
+    void to_steps(std::span<const Unit> in, std::span<Steps> out) const {
+        check(in.size(), out.size());
+        for (size_t i = 0; i < in.size(); ++i) {
+            out[i] = to_steps(in[i]);
+        }
+    }
+    void to_units(std::span<const Steps> in, std::span<Unit> out) const {
+        check(in.size(), out.size());
+        for (size_t i = 0; i < in.size(); ++i) {
+            out[i] = to_units(in[i]);
+        }
+    }
+    std::vector<Steps> to_steps(std::span<const Unit> in) const {
+        std::vector<Steps> out(in.size());
+        to_steps(in, out);
+        return out;
+    }
+    std::vector<Unit> to_units(std::span<const Steps> in) const {
+        std::vector<Unit> out(in.size());
+        to_units(in, out);
+        return out;
+    }
+
+    int64_t numerator() const { return _num; }
+    int64_t denominator() const { return _den; }
+
+private:
+    int64_t _num = 1;       //steps ...
+    int64_t _den = 1;       //... per this many units
+
+    static void check(size_t in, size_t out) {
+        if (in != out) {
+            throw std::invalid_argument("conversion needs as many outputs as inputs");
+        }
+    }
+};
+
+using DegreeConverter = ell_converter<Degrees>;
+using MillimeterConverter = ell_converter<Millimeters>;
+
+#endif // ELL_UNITS_H
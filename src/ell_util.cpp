@@ -53,25 +53,47 @@ bool elliptec::devispiezo(std::string addr) {
     return devintype("piezo", dev.value().type);
 }
 
+// pulses are per revolution for rotary and per mm for linear devices
+DegreeConverter elliptec::degree_converter(std::string addr) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    if (!devintype("rotary", dev.value().type)) {
+        throw std::invalid_argument("Device with address " + addr + " is not rotary");
+    }
+    return DegreeConverter(dev.value().pulses);
+}
+
+MillimeterConverter elliptec::millimeter_converter(std::string addr) {
+    auto dev = devinfo_at_addr(addr);
+    if (!dev.has_value()) {
+        throw std::runtime_error("Device with address " + addr + " not in connected device list");
+    }
+    if (!devintype("linear", dev.value().type)) {
+        throw std::invalid_argument("Device with address " + addr + " is not linear");
+    }
+    return MillimeterConverter(dev.value().pulses);
+}
+
 int64_t elliptec::deg2step(std::string addr, double deg) {
     auto dev = devinfo_at_addr(addr);
-    return std::round(dev.value().pulses * deg / 360);
+    return DegreeConverter(dev.value().pulses).to_steps(Degrees(deg)).value;
 }
 
 int64_t elliptec::mm2step(std::string addr, double mm){
     auto dev = devinfo_at_addr(addr);
-    return std::round(dev.value().pulses * mm);
+    return MillimeterConverter(dev.value().pulses).to_steps(Millimeters(mm)).value;
 }
 
 double elliptec::step2deg(std::string addr, int64_t step) {
     auto dev = devinfo_at_addr(addr);
-    double deg = 360.0 * step / dev.value().pulses;
-    return deg;
+    return DegreeConverter(dev.value().pulses).to_units(Steps(step)).value;
 }
 
 double elliptec::step2mm(std::string addr, int64_t step){
     auto dev = devinfo_at_addr(addr);
-    return 1.0 * step / dev.value().pulses;
+    return MillimeterConverter(dev.value().pulses).to_units(Steps(step)).value;
 }
 
 std::string elliptec::step2hex(int64_t step, uint8_t width) {
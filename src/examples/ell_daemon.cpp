@@ -0,0 +1,219 @@
+#include "ell_daemon.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int) {
+    running = 0;
+}
+
+int main(int argc, char **argv) {
+    std::string devname = "";
+    std::string sockpath = ELL_DAEMON_SOCKET;
+    std::vector<uint> mnum = std::vector<uint>(0);
+    ell_home_policy home_policy = HOME_ALWAYS;
+    std::string state_path = "";
+    ell_transport_config transport;
+    bool freqsearch = true;
+
+    /*
+     * parse arguments
+     */
+    try {
+        bpo::options_description args("Arguments");
+        args.add_options()
+            ("help,h", "prints this message")
+            ("device-path,d", bpo::value<std::string>(), "elliptec controller device path")
+            ("motor-id,i", bpo::value<std::vector<uint>>()->multitoken(), "motor ids connected to controller, scanned for if omitted")
+            ("socket,s", bpo::value<std::string>(), "unix socket path to serve on")
+            ("no-home", "do not home devices on startup, same as --home-policy never")
+            ("home-policy", bpo::value<std::string>()->default_value("always"), "homing on startup: always, if-needed, lazy or never")
+            ("state-file", bpo::value<std::string>()->default_value(""), "file persisting device positions between runs")
+            ("transport", bpo::value<std::string>()->default_value("boost"), "backend: boost, posix (low latency serial), tcp (device is host:port) or loopback (device lists emulated addr:type pairs)")
+            ("no-freqsearch", "do not search motor frequencies on startup")
+            ;
+
+        bpo::options_description cmdline_options;
+        cmdline_options.add(args);
+
+        bpo::variables_map vm;
+        store(bpo::command_line_parser(argc, argv).
+              options(cmdline_options).run(), vm);
+        notify(vm);
+
+        if (vm.count("help")) {
+            std::cout << "Usage: ./ell_daemon -d devicepath -i motorids [-s socketpath]\n";
+            std::cout << "Keeps elliptec devices initialised and serves commands over a unix socket.\n";
+            std::cout << args << "\n";
+            return 0;
+        }
+
+        if (vm.count("device-path")) {
+            devname = vm["device-path"].as< std::string >();
+        } else {
+            std::cout << "no device specified.\n";
+            return 1;
+        }
+        if (vm.count("motor-id")) {
+            mnum = (std::vector<uint>)vm["motor-id"].as< std::vector<uint >>();
+        } else {
+            std::cout << "no motor id specified, scanning the bus.\n";
+        }
+        if (vm.count("socket")) {
+            sockpath = vm["socket"].as< std::string >();
+        }
+        home_policy = home_policy_from_string(vm["home-policy"].as< std::string >());
+        state_path = vm["state-file"].as< std::string >();
+        transport.kind = transport_kind_from_string(vm["transport"].as< std::string >());
+        if (vm.count("no-home")) {
+            home_policy = HOME_NEVER;
+        }
+        freqsearch = !vm.count("no-freqsearch");
+    }
+    catch(std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        return 1;
+    }
+    catch(...) {
+        std::cerr << "Exception of unknown type!\n";
+        return 1;
+    }
+    std::vector<uint8_t> mnumvec;
+    for (auto mn: mnum) {
+        mnumvec.push_back(mn);
+    }
+
+    elliptec dev = elliptec(devname, mnumvec, home_policy, freqsearch, state_path, transport);
+
+    /*
+     * socket
+     */
+    sockaddr_un sa{};
+    if (sockpath.length() >= sizeof(sa.sun_path)) {
+        std::cerr << "socket path too long: " << sockpath << "\n";
+        return 1;
+    }
+    sa.sun_family = AF_UNIX;
+    std::strncpy(sa.sun_path, sockpath.c_str(), sizeof(sa.sun_path) - 1);
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(sockpath.c_str());
+    if ((lfd < 0) || (bind(lfd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) || (listen(lfd, 16) != 0)) {
+        std::cerr << "cannot listen on " << sockpath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cout << "serving on " << sockpath << std::endl;
+
+    /*
+     * serve. Requests are handled one at a time, in arrival order; the
+     * serial bus serialises them anyway.
+     */
+    std::vector<pollfd> fds = {{lfd, POLLIN, 0}};
+    std::vector<std::string> pending = {""};
+    while (running) {
+        int n = poll(fds.data(), fds.size(), 500);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "poll failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        if (fds.at(0).revents & POLLIN) {
+            int cfd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (cfd >= 0) {
+                fds.push_back({cfd, POLLIN, 0});
+                pending.push_back("");
+            }
+        }
+        for (size_t i = fds.size() - 1; i >= 1; --i) {
+            if (!(fds.at(i).revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            char buf[256];
+            ssize_t len = read(fds.at(i).fd, buf, sizeof(buf));
+            bool drop = (len <= 0);
+            if (!drop) {
+                pending.at(i).append(buf, len);
+            }
+            while (!drop && (pending.at(i).size() >= sizeof(ell_daemon_request))) {
+                ell_daemon_request req;
+                std::memcpy(&req, pending.at(i).data(), sizeof(req));
+                pending.at(i).erase(0, sizeof(req));
+
+                std::string msg = "";
+                ell_daemon_reply rep = handle_request(dev, req, msg);
+                rep.msglen = msg.length();
+                std::string out(reinterpret_cast<const char*>(&rep), sizeof(rep));
+                out += msg;
+                drop = (write(fds.at(i).fd, out.data(), out.size()) != ssize_t(out.size()));
+            }
+            if (drop) {
+                close(fds.at(i).fd);
+                fds.erase(fds.begin() + i);
+                pending.erase(pending.begin() + i);
+            }
+        }
+    }
+
+    for (auto &p: fds) {
+        close(p.fd);
+    }
+    unlink(sockpath.c_str());
+    dev.close();
+
+    return 0;
+}
+
+ell_daemon_reply handle_request(elliptec &dev, const ell_daemon_request &req, std::string &msg) {
+    ell_daemon_reply rep{};
+    rep.result = RESULT_OK;
+    if (!std::isxdigit(static_cast<unsigned char>(req.addr))) {
+        rep.result = RESULT_BAD_REQUEST;
+        msg = "bad device address";
+        return rep;
+    }
+    std::string addr(1, std::toupper(static_cast<unsigned char>(req.addr)));
+    try {
+        switch (req.op) {
+            case OP_MOVE_ABSOLUTE:
+                dev.move_absolute(addr, req.value);
+                break;
+            case OP_MOVE_RELATIVE:
+                dev.move_relative(addr, req.value);
+                break;
+            case OP_HOME:
+                dev.home(addr);
+                break;
+            case OP_STOP:
+                dev.stop(addr);
+                break;
+            case OP_MOVE_FWD:
+                dev.move_fwd(addr);
+                break;
+            case OP_MOVE_BWD:
+                dev.move_bwd(addr);
+                break;
+            case OP_GET_POSITION:
+                rep.value = dev.get_position(addr);
+                break;
+            case OP_GET_STATUS:
+                rep.code = dev.get_status(addr);
+                break;
+            case OP_GET_VELOCITY:
+                rep.value = dev.get_velocity(addr);
+                break;
+            case OP_SET_VELOCITY:
+                dev.set_velocity(addr, uint8_t(std::clamp(req.value, 0.0, 100.0)));
+                break;
+            default:
+                rep.result = RESULT_BAD_REQUEST;
+                msg = "unknown operation " + std::to_string(req.op);
+        }
+    } catch (const std::exception& e) {
+        rep.result = RESULT_ERROR;
+        msg = e.what();
+    }
+    return rep;
+}
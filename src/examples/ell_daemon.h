@@ -0,0 +1,16 @@
+#include "elliptec.h"
+#include "ell_client.h"
+#include <vector>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+
+namespace bpo = boost::program_options;
+ell_daemon_reply handle_request(elliptec &dev, const ell_daemon_request &req, std::string &msg);
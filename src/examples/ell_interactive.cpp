@@ -3,6 +3,11 @@
 int main(int argc, char **argv) {
     std::string devname = "";
     std::vector<uint> mnum = std::vector<uint>(0);
+    ell_home_policy home_policy = HOME_ALWAYS;
+    std::string state_path = "";
+    ell_transport_config transport;
+    std::string script_path = "";
+    bool quiet = false;
     
     /*
      * parse arguments
@@ -12,7 +17,12 @@ int main(int argc, char **argv) {
         args.add_options()
             ("help,h", "prints this message")
             ("device-path,d", bpo::value<std::string>(), "elliptec controller device path")
-            ("motor-id,i", bpo::value<std::vector<uint>>()->multitoken(), "motor ids connected to controller")
+            ("motor-id,i", bpo::value<std::vector<uint>>()->multitoken(), "motor ids connected to controller, scanned for if omitted")
+            ("home-policy", bpo::value<std::string>()->default_value("always"), "homing on startup: always, if-needed, lazy or never")
+            ("state-file", bpo::value<std::string>()->default_value(""), "file persisting device positions between runs")
+            ("transport", bpo::value<std::string>()->default_value("boost"), "backend: boost, posix (low latency serial), tcp (device is host:port) or loopback (device lists emulated addr:type pairs)")
+            ("script,s", bpo::value<std::string>(), "run the commands of this file, - for stdin, instead of the prompt")
+            ("quiet,q", "no output for every reply, as verbose off at the prompt")
             ;
         
         bpo::options_description cmdline_options;
@@ -39,11 +49,15 @@ int main(int argc, char **argv) {
         if (vm.count("motor-id")) {
             mnum = (std::vector<uint>)vm["motor-id"].as< std::vector<uint >>();
         } else {
-            std::cout << "no motor id specified.\n";
-            return 1;
+            std::cout << "no motor id specified, scanning the bus.\n";
         }
-        
-        
+        home_policy = home_policy_from_string(vm["home-policy"].as< std::string >());
+        state_path = vm["state-file"].as< std::string >();
+        transport.kind = transport_kind_from_string(vm["transport"].as< std::string >());
+        if (vm.count("script")) {
+            script_path = vm["script"].as< std::string >();
+        }
+        quiet = vm.count("quiet") > 0;
     }
     catch(std::exception& e) {
         std::cerr << "error: " << e.what() << "\n";
@@ -58,7 +72,24 @@ int main(int argc, char **argv) {
         mnumvec.push_back(mn);
     }
     
-    elliptec dev = elliptec(devname, mnumvec, true, true);
+    elliptec dev = elliptec(devname, mnumvec, home_policy, true, state_path, transport);
+    dev.set_quiet(quiet);
+
+    if (script_path != "") {
+        int ret = 0;
+        if (!script_path.compare("-")) {
+            ret = run_script(dev, std::cin);
+        } else {
+            std::ifstream script(script_path);
+            if (!script) {
+                std::cerr << "cannot open script " << script_path << "\n";
+                return 1;
+            }
+            ret = run_script(dev, script);
+        }
+        dev.close();
+        return ret;
+    }
     
     /*
      * command prompt
@@ -74,13 +105,13 @@ int main(int argc, char **argv) {
     linenoise::SetHistoryMaxLen(256);
     linenoise::LoadHistory(prompt_history_file.c_str());
 
+    auto executor = std::make_unique<command_executor>(dev);
+    std::unique_ptr<device_watch> watch;
+
     while (true) {
         // Read line
         std::string line;
         std::vector<std::string> linevec;
-        std::string cmd;
-        std::string id;
-        std::vector<std::string> args;
         auto quit = linenoise::Readline("> ", line);
 
         if (quit) {
@@ -92,94 +123,40 @@ int main(int argc, char **argv) {
         if (linevec.empty()==true) {
             continue;
         } 
-        if (linevec.size()>0) {
-            cmd = linevec.at(0);
-            if (linevec.size()>1) {
-                id = linevec.at(1);
-                if (linevec.size()>2) {
-                    args = {linevec.begin()+2, linevec.end()};
-                }
-            }
-        }
-    
+
+        const std::string &cmd = linevec.at(0);
         try {
-            if (!cmd.compare("help")) {
-                std::cout << "known commands: \n";
-                std::cout << "|short|command       paramters       \n";
-                std::cout << "|-----|------------------------------\n";
-                std::cout << "| ma  |moveabsolute  <id> <angle/mm> \n";
-                std::cout << "| mr  |moverelative  <id> <angle/mm> \n";
-                std::cout << "| mf  |moveforwards  <id>            \n";
-                std::cout << "| mb  |movebackwards <id>            \n";
-                std::cout << "|     |stop          <id>            \n";
-                std::cout << "| gv  |getvelocity   <id>            \n";
-                std::cout << "| sv  |setvelocity   <id> <percent>  \n";
-                std::cout << "| gj  |getjogsize    <id>            \n";
-                std::cout << "| sj  |setjogsize    <id> <angle/mm> \n";
-                std::cout << "| po  |getpos        <id>            \n";
-                std::cout << "| i   |info          <id>            \n";
-                std::cout << "|     |status        <id>            \n";
-                std::cout << "|     |save          <id>            \n";
-                std::cout << "|     |change_id     <oldid> <newid> \n";
-                std::cout << "|     |search_freq   <id>            \n";
-                std::cout << "| ho  |home          <id>            \n";
-                std::cout << "|     |clean         <id>            \n";
-                std::cout << "|     |optimize      <id>            \n";
-                std::cout << "|  q  |quit                          \n";
-            } else if ((!cmd.compare("moveabsolute")) || (!cmd.compare("ma"))) {
-                dev.move_absolute(id, std::stod(args.at(0)));
-            } else if ((!cmd.compare("moverelative")) || (!cmd.compare("mr"))) {
-                dev.move_relative(id, std::stod(args.at(0)));
-            } else if ((!cmd.compare("info")) || (!cmd.compare("i"))) {
-                dev.get_info(id);
-                dev.print_addr_info(id);
-            } else if (!cmd.compare("status")) {
-                dev.get_status(id);
-            } else if (!cmd.compare("save")) {
-                dev.save_userdata(id);
-            } else if ((!cmd.compare("home")) || (!cmd.compare("ho"))) {
-                dev.home(id);
-            } else if ((!cmd.compare("getpos")) || (!cmd.compare("po"))) {
-                dev.get_position(id);
+            if ((!cmd.compare("quit")) || (!cmd.compare("q"))) {
+                break;
+            } else if (!cmd.compare("help")) {
+                run_command(dev, linevec);
+            } else if (!cmd.compare("jobs")) {
+                executor->print_jobs();
+            } else if (!cmd.compare("cancel")) {
+                executor->cancel(std::stoul(linevec.at(1)));
             } else if (!cmd.compare("stop")) {
-                dev.stop(id);
-            } else if ((!cmd.compare("getvelocity")) || (!cmd.compare("gv"))) {
-                dev.get_velocity(id);
-            } else if ((!cmd.compare("setvelocity")) || (!cmd.compare("sv"))) {
-                unsigned long arg = std::stoul(args.at(0));
-                uint8_t percent = 0;
-                if (arg<100) {
-                    percent = arg;
-                } else {
-                    percent=100;
+                executor->stop(linevec.at(1));
+            } else if (!cmd.compare("watch")) {
+                std::vector<std::string> ids;
+                double rate_hz = 0;
+                for (size_t i = 1; i < linevec.size(); ++i) {
+                    if (!linevec[i].compare("-r")) {
+                        rate_hz = std::stod(linevec.at(++i));
+                    } else if ((linevec[i].length() == 1) && std::isxdigit(static_cast<unsigned char>(linevec[i][0]))) {
+                        ids.push_back(linevec[i]);
+                    } else {
+                        throw std::invalid_argument("watch: " + linevec[i] + " is no device id, the rate goes after -r");
+                    }
                 }
-                dev.set_velocity(id,percent);
-            } else if ((!cmd.compare("moveforwards")) || (!cmd.compare("mf"))) {
-                dev.move_fwd(id);
-            } else if ((!cmd.compare("movebackwards")) || (!cmd.compare("mb"))) {
-                dev.move_bwd(id);
-            } else if ((!cmd.compare("getjogsize")) || (!cmd.compare("gj"))) {
-                dev.get_jogstep_size(id);
-            } else if ((!cmd.compare("setjogsize")) || (!cmd.compare("sj"))) {
-                dev.set_jogstep_size(id, std::stod(args.at(0)));
-            } else if (!cmd.compare("change_id")) {
-                if (args.empty()) {
-                    std::cout << "need to specify new address" << std::endl;
-                    continue;
-                } else {
-                    dev.change_address(id, args.at(0));
-                }
-            } else if (!cmd.compare("clean")) {
-                dev.clean_mechanics(id);
-            }else if (!cmd.compare("stopclean")) {
-                dev.stop_clean(id);
-            } else if (!cmd.compare("search_freq")) {
-                dev.search_freq(id);
-            } else if (!cmd.compare("optimize")) {
-                dev.optimize_motors(id);
-            } else if ((!cmd.compare("quit")) || (!cmd.compare("q"))) {
-                break;
-            } 
+                watch.reset();
+                watch = std::make_unique<device_watch>(dev, ids, rate_hz);
+            } else if (!cmd.compare("unwatch")) {
+                watch.reset();
+            } else if (!cmd.compare("verbose")) {
+                dev.set_quiet(!linevec.at(1).compare("off"));
+            } else {
+                executor->submit(linevec);
+            }
         } catch (const std::exception& e) {
             std::cout << e.what() << std::endl;
             continue;
@@ -187,12 +164,677 @@ int main(int argc, char **argv) {
         linenoise::AddHistory(line.c_str());
         linenoise::SaveHistory(prompt_history_file.c_str());
     }
+    watch.reset();
+    executor.reset();
     
     dev.close();
     
     return 0;
 }
 
+// \return false for quit
+bool run_command(elliptec &dev, const std::vector<std::string> &linevec) {
+    std::string cmd;
+    std::string id;
+    std::vector<std::string> args;
+    if (linevec.size()>0) {
+        cmd = linevec.at(0);
+        if (linevec.size()>1) {
+            id = linevec.at(1);
+            if (linevec.size()>2) {
+                args = {linevec.begin()+2, linevec.end()};
+            }
+        }
+    }
+
+    if (!cmd.compare("help")) {
+        std::cout << "known commands: \n";
+        std::cout << "|short|command       paramters       \n";
+        std::cout << "|-----|------------------------------\n";
+        std::cout << "| ma  |moveabsolute  <id> <angle/mm> \n";
+        std::cout << "| mr  |moverelative  <id> <angle/mm> \n";
+        std::cout << "| mf  |moveforwards  <id>            \n";
+        std::cout << "| mb  |movebackwards <id>            \n";
+        std::cout << "|     |stop          <id|all>        \n";
+        std::cout << "| gv  |getvelocity   <id>            \n";
+        std::cout << "| sv  |setvelocity   <id> <percent>  \n";
+        std::cout << "| gj  |getjogsize    <id>            \n";
+        std::cout << "| sj  |setjogsize    <id> <angle/mm> \n";
+        std::cout << "| po  |getpos        <id>            \n";
+        std::cout << "| i   |info          <id>            \n";
+        std::cout << "|     |status        <id|all>        \n";
+        std::cout << "|     |save          <id>            \n";
+        std::cout << "|     |change_id     <oldid> <newid> \n";
+        std::cout << "|     |search_freq   <id>            \n";
+        std::cout << "| ho  |home          <id>            \n";
+        std::cout << "|     |clean         <id>            \n";
+        std::cout << "|     |optimize      <id>            \n";
+        std::cout << "|     |jobs                          \n";
+        std::cout << "|     |cancel        <job>           \n";
+        std::cout << "|     |watch         <id...> [-r Hz] \n";
+        std::cout << "|     |unwatch                       \n";
+        std::cout << "|     |verbose       <on|off>        \n";
+        std::cout << "|  q  |quit                          \n";
+    } else if ((!cmd.compare("moveabsolute")) || (!cmd.compare("ma"))) {
+        dev.move_absolute(id, std::stod(args.at(0)));
+    } else if ((!cmd.compare("moverelative")) || (!cmd.compare("mr"))) {
+        dev.move_relative(id, std::stod(args.at(0)));
+    } else if ((!cmd.compare("info")) || (!cmd.compare("i"))) {
+        dev.get_info(id);
+        dev.print_addr_info(id);
+    } else if (!cmd.compare("status") && !id.compare("all")) {
+        auto status = dev.try_status_all();
+        for (const auto &[a, code] : std::map<std::string, ell_expected<uint8_t>>(status.begin(), status.end())) {
+            if (code) {
+                std::cout << a << ": status " << unsigned(*code) << ((*code < error_msgs.size()) ? " " + error_msgs[*code] : "") << std::endl;
+            } else {
+                std::cout << a << ": " << code.error().message << std::endl;
+            }
+        }
+    } else if (!cmd.compare("status")) {
+        uint8_t status = dev.get_status(id);
+        if (dev.quiet()) {
+            std::cout << id << ": status " << unsigned(status) << std::endl;
+        }
+    } else if (!cmd.compare("save")) {
+        dev.save_userdata(id);
+    } else if ((!cmd.compare("home")) || (!cmd.compare("ho"))) {
+        dev.home(id);
+    } else if ((!cmd.compare("getpos")) || (!cmd.compare("po"))) {
+        double pos = dev.get_position(id);
+        if (dev.quiet()) {
+            std::cout << id << ": position " << pos << std::endl;
+        }
+    } else if (!cmd.compare("stop")) {
+        dev.stop(id);
+    } else if ((!cmd.compare("getvelocity")) || (!cmd.compare("gv"))) {
+        uint8_t percent = dev.get_velocity(id);
+        if (dev.quiet()) {
+            std::cout << id << ": velocity " << unsigned(percent) << " %" << std::endl;
+        }
+    } else if ((!cmd.compare("setvelocity")) || (!cmd.compare("sv"))) {
+        unsigned long arg = std::stoul(args.at(0));
+        uint8_t percent = 0;
+        if (arg<100) {
+            percent = arg;
+        } else {
+            percent=100;
+        }
+        dev.set_velocity(id,percent);
+    } else if ((!cmd.compare("moveforwards")) || (!cmd.compare("mf"))) {
+        dev.move_fwd(id);
+    } else if ((!cmd.compare("movebackwards")) || (!cmd.compare("mb"))) {
+        dev.move_bwd(id);
+    } else if ((!cmd.compare("getjogsize")) || (!cmd.compare("gj"))) {
+        double jog = dev.get_jogstep_size(id);
+        if (dev.quiet()) {
+            std::cout << id << ": jog step " << jog << std::endl;
+        }
+    } else if ((!cmd.compare("setjogsize")) || (!cmd.compare("sj"))) {
+        dev.set_jogstep_size(id, std::stod(args.at(0)));
+    } else if (!cmd.compare("change_id")) {
+        if (args.empty()) {
+            std::cout << "need to specify new address" << std::endl;
+        } else {
+            dev.change_address(id, args.at(0));
+        }
+    } else if (!cmd.compare("clean")) {
+        dev.clean_mechanics(id);
+    }else if (!cmd.compare("stopclean")) {
+        dev.stop_clean(id);
+    } else if (!cmd.compare("search_freq")) {
+        dev.search_freq(id);
+    } else if (!cmd.compare("optimize")) {
+        dev.optimize_motors(id);
+    } else if ((!cmd.compare("quit")) || (!cmd.compare("q"))) {
+        return false;
+    } else {
+        throw std::invalid_argument("unknown command " + cmd + ", see help");
+    }
+    return true;
+}
+
+/*
+ * background execution
+ */
+command_executor::command_executor(elliptec &dev) : _dev(dev) {
+    _worker = std::thread(&command_executor::loop, this);
+}
+
+command_executor::~command_executor() {
+    std::vector<uint32_t> background;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stop = true;
+        for (const job &j : _jobs) {
+            if (j.state == JOB_MAINTENANCE) {
+                background.push_back(j.background_id);
+            }
+        }
+    }
+    _cv.notify_all();
+    _worker.join();
+    for (std::future<void> &f : _stoppers) {
+        f.wait();
+    }
+    for (uint32_t id : background) {
+        _dev.remove_background_job(id);
+    }
+}
+
+uint32_t command_executor::submit(const std::vector<std::string> &words) {
+    job j;
+    j.words = words;
+    j.address = (words.size() > 1) ? words.at(1) : "";
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        j.id = _next_id++;
+        _jobs.push_back(j);
+    }
+    _cv.notify_all();
+    return j.id;
+}
+
+void command_executor::print_jobs() {
+    static const char *states[] = {"queued", "running", "background"};
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_jobs.empty()) {
+        std::cout << "no jobs" << std::endl;
+    }
+    for (const job &j : _jobs) {
+        std::cout << "[" << j.id << "] " << std::left << std::setw(11) << states[j.state] << std::right;
+        if (j.state != JOB_QUEUED) {
+            std::cout << std::setw(8) << std::chrono::duration_cast<std::chrono::seconds>(now - j.started).count() << " s  ";
+        } else {
+            std::cout << "            ";
+        }
+        std::cout << join(j.words) << std::endl;
+    }
+}
+
+// A running command is a motion at most and ends by itself; use stop.
+void command_executor::cancel(uint32_t id) {
+    uint32_t background = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = std::find_if(_jobs.begin(), _jobs.end(), [id](const job &j) { return j.id == id; });
+        if (it == _jobs.end()) {
+            std::cout << "no job " << id << std::endl;
+            return;
+        }
+        if (it->state == JOB_ACTIVE) {
+            std::cout << "[" << id << "] is running, stop " << it->address << " ends it" << std::endl;
+            return;
+        }
+        background = (it->state == JOB_MAINTENANCE) ? it->background_id : 0;
+        _jobs.erase(it);
+    }
+    if (background) {
+        _dev.remove_background_job(background);
+    }
+    std::cout << "[" << id << "] cancelled" << std::endl;
+}
+
+// Runs on the prompt thread and must not wait for the bus: the stop itself
+// goes out from a thread of its own, with stop_now() for the device whose
+// command holds the bus.
+void command_executor::stop(const std::string &addr) {
+    const bool all = !addr.compare("all");
+    std::vector<uint32_t> background;
+    std::string active;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto it = _jobs.begin(); it != _jobs.end();) {
+            if (it->state == JOB_ACTIVE) {
+                active = it->address;
+            }
+            if ((all || (it->address == addr)) && (it->state != JOB_ACTIVE)) {
+                if (it->state == JOB_MAINTENANCE) {
+                    background.push_back(it->background_id);
+                }
+                std::cout << "[" << it->id << "] cancelled" << std::endl;
+                it = _jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::erase_if(_stoppers, [](const std::future<void> &f) { return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+        _stoppers.push_back(std::async(std::launch::async, [this, addr, all, active, background] {
+            try {
+                if (all) {
+                    if (active.length() == 1) {
+                        _dev.stop_now(active);
+                    }
+                    auto stopped = _dev.try_stop_all();
+                    for (const auto &[a, pos] : std::map<std::string, ell_expected<double>>(stopped.begin(), stopped.end())) {
+                        if (pos) {
+                            std::cout << a << ": stopped at " << *pos << std::endl;
+                        } else {
+                            std::cout << a << ": " << pos.error().message << std::endl;
+                        }
+                    }
+                } else {
+                    _dev.stop_now(addr);
+                }
+                for (uint32_t id : background) {
+                    _dev.remove_background_job(id);
+                }
+            } catch (const std::exception &e) {
+                std::cout << "stop " << addr << ": " << e.what() << std::endl;
+            }
+        }));
+    }
+}
+
+void command_executor::loop() {
+    while (true) {
+        std::vector<std::string> words;
+        uint32_t id = 0;
+        std::string address;
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            auto queued = [this] { return std::find_if(_jobs.begin(), _jobs.end(), [](const job &j) { return j.state == JOB_QUEUED; }); };
+            _cv.wait_for(lock, std::chrono::milliseconds(100), [&] { return _stop || (queued() != _jobs.end()); });
+            if (_stop) {
+                return;
+            }
+            auto it = queued();
+            if (it != _jobs.end()) {
+                it->state = JOB_ACTIVE;
+                it->started = std::chrono::steady_clock::now();
+                words = it->words;
+                id = it->id;
+                address = it->address;
+            }
+        }
+        if (id == 0) {
+            check_maintenance();
+            continue;
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::optional<ell_maint_op> op = maintenance_op(words.at(0));
+        uint32_t background = 0;
+        std::string result;
+        try {
+            if (op.has_value()) {
+                background = _dev.add_background_job(address, op.value(), std::chrono::seconds(0));
+                result = "started";
+            } else {
+                run_command(_dev, words);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                std::ostringstream ss;
+                ss << "done in " << std::fixed << std::setprecision(1) << ms << " ms";
+                result = ss.str();
+            }
+        } catch (const std::exception &e) {
+            result = std::string("failed: ") + e.what();
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            auto it = std::find_if(_jobs.begin(), _jobs.end(), [id](const job &j) { return j.id == id; });
+            if (it != _jobs.end()) {
+                if (background) {
+                    it->state = JOB_MAINTENANCE;
+                    it->background_id = background;
+                } else {
+                    _jobs.erase(it);
+                }
+            }
+        }
+        std::cout << "[" << id << "] " << result << ": " << join(words) << std::endl;
+    }
+}
+
+// reports maintenance the library finished
+void command_executor::check_maintenance() {
+    std::vector<ell_job_info> infos = _dev.background_jobs();
+    std::vector<uint32_t> finished;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto it = _jobs.begin(); it != _jobs.end();) {
+            if (it->state != JOB_MAINTENANCE) {
+                ++it;
+                continue;
+            }
+            uint32_t background = it->background_id;
+            auto info = std::find_if(infos.begin(), infos.end(), [background](const ell_job_info &i) { return i.id == background; });
+            if ((info != infos.end()) && ((info->state == JOB_DONE) || (info->state == JOB_FAILED))) {
+                auto s = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - it->started).count();
+                std::cout << "[" << it->id << "] " << ((info->state == JOB_DONE) ? "done" : "failed, status " + std::to_string(info->status))
+                          << " after " << s << " s: " << join(it->words) << std::endl;
+                finished.push_back(background);
+                it = _jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (uint32_t background : finished) {
+        _dev.remove_background_job(background);
+    }
+}
+
+/*
+ * watch
+ *
+ * The table sits above a scroll region holding the prompt and all other
+ * output; it is redrawn with the cursor saved and restored around it.
+ */
+device_watch::device_watch(elliptec &dev, const std::vector<std::string> &addrs, double rate_hz) : _dev(dev), _rate_hz(rate_hz) {
+    if (addrs.empty()) {
+        throw std::invalid_argument("watch needs at least one id");
+    }
+    for (const std::string &addr : addrs) {
+        row r;
+        r.address = addr;
+        _rows.push_back(r);
+    }
+    _was_quiet = _dev.quiet();
+    _dev.set_quiet(true);
+    size_t top = _rows.size() + 4;
+    std::cout << "\x1b[2J\x1b[" << top << ";r\x1b[" << top << ";1H" << std::flush;
+    draw(0);
+    _worker = std::thread(&device_watch::loop, this);
+}
+
+device_watch::~device_watch() {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stop = true;
+    }
+    _cv.notify_all();
+    _worker.join();
+    std::cout << "\x1b" "7\x1b[r\x1b" "8" << std::flush;
+    _dev.set_quiet(_was_quiet);
+}
+
+void device_watch::loop() {
+    using clock = std::chrono::steady_clock;
+    size_t next = 0;
+    double hz = 0;
+    auto round_start = clock::now();
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (!_stop) {
+        lock.unlock();
+        clock::duration pause = std::chrono::milliseconds(BUS_RETRY_MS);
+        auto bus = _dev.try_claim_bus();
+        if (bus.owns_lock()) {
+            auto t0 = clock::now();
+            poll(_rows[next]);
+            auto busy = clock::now() - t0;
+            bus.unlock();
+            next = (next + 1) % _rows.size();
+            if (next == 0) {
+                auto now = clock::now();
+                hz = 1.0/std::chrono::duration<double>(now - round_start).count();
+                round_start = now;
+            }
+            draw(hz);
+
+            pause = std::chrono::duration_cast<clock::duration>(busy*(1.0/BUS_SHARE - 1.0));
+            if (_rate_hz > 0) {
+                auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0/(_rate_hz*_rows.size())));
+                pause = std::max(pause, interval - busy);
+            }
+        }
+        lock.lock();
+        _cv.wait_for(lock, pause, [this] { return _stop; });
+    }
+}
+
+void device_watch::poll(row &r) {
+    auto pos = _dev.try_get_position(r.address);
+    if (pos) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(4) << *pos;
+        r.position = ss.str();
+    } else {
+        r.position = "no reply";
+    }
+    auto status = _dev.try_get_status(r.address);
+    if (status) {
+        r.status = std::to_string(*status);
+        if (*status < error_msgs.size()) {
+            r.status += " " + error_msgs[*status].substr(0, 32);
+        }
+    } else {
+        r.status = "no reply";
+    }
+    try {
+        r.velocity = std::to_string(_dev.get_velocity(r.address)) + " %";
+    } catch (const std::exception &) {
+        r.velocity = "-";
+    }
+}
+
+void device_watch::draw(double hz) {
+    std::ostringstream ss;
+    ss << "\x1b" "7";
+    auto line = [&ss](size_t n, const std::string &text) {
+        ss << "\x1b[" << n << ";1H\x1b[2K" << text;
+    };
+    std::ostringstream title;
+    title << "watching " << _rows.size() << " devices, " << std::fixed << std::setprecision(1) << hz << " Hz each, unwatch to stop";
+    line(1, title.str());
+    std::ostringstream head;
+    head << std::left << std::setw(4) << "id" << std::setw(14) << "position" << std::setw(10) << "velocity" << "status";
+    line(2, head.str());
+    for (size_t i = 0; i < _rows.size(); ++i) {
+        const row &r = _rows[i];
+        std::ostringstream text;
+        text << std::left << std::setw(4) << r.address << std::setw(14) << r.position << std::setw(10) << r.velocity << r.status;
+        line(i + 3, text.str());
+    }
+    line(_rows.size() + 3, std::string(60, '-'));
+    ss << "\x1b" "8";
+    std::cout << ss.str() << std::flush;
+}
+
+std::optional<ell_maint_op> maintenance_op(const std::string &cmd) {
+    if (!cmd.compare("clean")) {
+        return MAINT_CLEAN;
+    } else if (!cmd.compare("optimize")) {
+        return MAINT_OPTIMIZE;
+    } else if (!cmd.compare("search_freq")) {
+        return MAINT_SEARCH_FREQ;
+    }
+    return std::nullopt;
+}
+
+std::string join(const std::vector<std::string> &words) {
+    std::string ret;
+    for (const std::string &w : words) {
+        ret += (ret.empty() ? "" : " ") + w;
+    }
+    return ret;
+}
+
+/*
+ * script mode
+ *
+ * One prompt command per line, # starts a comment. On top of the prompt
+ * commands a script knows
+ *   set <name> <value>                 $name in later lines is replaced by value
+ *   for <name> <from> <to> <step>      repeats the lines up to the matching end
+ *   end                                with $name running from from to to
+ * Consecutive moveabsolute lines for different devices are sent together
+ * with move_together and wait for all replies at once. Unlike a single ma
+ * they are not retried; each device that misses its target counts as a
+ * failed command. Every command is timed and a summary per command follows
+ * at the end.
+ */
+std::vector<script_line> read_script(std::istream &in) {
+    std::vector<script_line> lines;
+    std::string line;
+    size_t number = 0;
+    while (std::getline(in, line)) {
+        ++number;
+        std::vector<std::string> words = split(line.substr(0, line.find('#')));
+        if (!words.empty()) {
+            lines.push_back({number, words});
+        }
+    }
+    return lines;
+}
+
+// index of the end matching the for at begin
+size_t block_end(const std::vector<script_line> &lines, size_t begin) {
+    size_t depth = 0;
+    for (size_t i = begin; i < lines.size(); ++i) {
+        if (!lines[i].words[0].compare("for")) {
+            ++depth;
+        } else if (!lines[i].words[0].compare("end") && (--depth == 0)) {
+            return i;
+        }
+    }
+    throw std::runtime_error("line " + std::to_string(lines[begin].number) + ": for without end");
+}
+
+std::vector<std::string> substitute(const std::vector<std::string> &words, const std::map<std::string, std::string> &vars) {
+    std::vector<std::string> ret = words;
+    for (std::string &w : ret) {
+        if ((w.size() > 1) && (w[0] == '$')) {
+            auto it = vars.find(w.substr(1));
+            if (it == vars.end()) {
+                throw std::runtime_error("unknown variable " + w);
+            }
+            w = it->second;
+        }
+    }
+    return ret;
+}
+
+bool is_moveabsolute(const std::vector<std::string> &words) {
+    return ((!words[0].compare("moveabsolute")) || (!words[0].compare("ma"))) && (words.size() > 2);
+}
+
+void run_block(elliptec &dev, const std::vector<script_line> &lines, size_t begin, size_t end, script_run &run) {
+    for (size_t i = begin; (i < end) && !run.quit; ++i) {
+        const script_line &line = lines[i];
+        std::vector<std::string> words;
+        try {
+            words = substitute(line.words, run.vars);
+        } catch (const std::exception &e) {
+            ++run.errors;
+            std::cout << "line " << line.number << ": " << e.what() << std::endl;
+            continue;
+        }
+        const std::string &cmd = words[0];
+        if (!cmd.compare("set")) {
+            if (words.size() != 3) {
+                throw std::runtime_error("line " + std::to_string(line.number) + ": set <name> <value>");
+            }
+            run.vars[words[1]] = words[2];
+            continue;
+        }
+        if (!cmd.compare("for")) {
+            size_t stop = block_end(lines, i);
+            if (words.size() != 5) {
+                throw std::runtime_error("line " + std::to_string(line.number) + ": for <name> <from> <to> <step>");
+            }
+            double from = std::stod(words[2]);
+            double to = std::stod(words[3]);
+            double step = std::stod(words[4]);
+            if (step == 0) {
+                throw std::runtime_error("line " + std::to_string(line.number) + ": step must not be 0");
+            }
+            double span = (to - from)/step;
+            size_t count = (span < 0) ? 0 : size_t(std::floor(span + 1e-9)) + 1;
+            for (size_t k = 0; (k < count) && !run.quit; ++k) {
+                std::ostringstream value;
+                value << std::setprecision(12) << from + k*step;
+                run.vars[words[1]] = value.str();
+                run_block(dev, lines, i + 1, stop, run);
+            }
+            i = stop;
+            continue;
+        }
+        if (!cmd.compare("end")) {
+            throw std::runtime_error("line " + std::to_string(line.number) + ": end without for");
+        }
+
+        std::vector<std::vector<std::string>> group = {words};
+        if (is_moveabsolute(words)) {
+            // a line that cannot be substituted is left to report its own error
+            while ((i + 1 < end) && is_moveabsolute(lines[i + 1].words)) {
+                std::vector<std::string> next;
+                try {
+                    next = substitute(lines[i + 1].words, run.vars);
+                } catch (const std::exception &) {
+                    break;
+                }
+                if (std::any_of(group.begin(), group.end(), [&](const std::vector<std::string> &g) { return g[1] == next[1]; })) {
+                    break;
+                }
+                group.push_back(next);
+                ++i;
+            }
+        }
+
+        std::string text;
+        for (const auto &g : group) {
+            text += (text.empty() ? "" : " | ") + join(g);
+        }
+        std::string name = (group.size() > 1) ? "ma (pipelined)" : cmd;
+        bool ok = true;
+        auto t0 = std::chrono::steady_clock::now();
+        try {
+            if (group.size() > 1) {
+                std::vector<std::pair<std::string, double>> targets;
+                for (const auto &g : group) {
+                    targets.emplace_back(g[1], std::stod(g[2]));
+                }
+                ell_multi_move_result res = dev.move_together(targets, false);
+                for (size_t k = 0; k < res.reached.size(); ++k) {
+                    if (!res.reached[k]) {
+                        ok = false;
+                        ++run.errors;
+                        std::cout << "line " << line.number << ": " << targets[k].first << " missed its target" << std::endl;
+                    }
+                }
+            } else if (!run_command(dev, words)) {
+                run.quit = true;
+            }
+        } catch (const std::exception &e) {
+            ok = false;
+            ++run.errors;
+            std::cout << "line " << line.number << ": " << e.what() << std::endl;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        command_time &t = run.times[name];
+        ++t.count;
+        t.total_ms += ms;
+        t.max_ms = std::max(t.max_ms, ms);
+        run.commands += group.size();
+        std::cout << std::fixed << std::setprecision(1) << std::setw(9) << ms << " ms  " << text << (ok ? "" : "  (failed)") << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+// \return 0 if every command succeeded
+int run_script(elliptec &dev, std::istream &in) {
+    script_run run;
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+        std::vector<script_line> lines = read_script(in);
+        run_block(dev, lines, 0, lines.size(), run);
+    } catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+        ++run.errors;
+    }
+    double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    std::cout << "\n" << run.commands << " commands, " << run.errors << " failed, " << std::fixed << std::setprecision(1) << total << " ms\n";
+    std::cout << "command              count   total ms    mean ms     max ms\n";
+    for (const auto &[name, t] : run.times) {
+        std::cout << std::left << std::setw(18) << name << std::right << std::setw(8) << t.count
+                  << std::setw(11) << t.total_ms << std::setw(11) << t.total_ms/t.count << std::setw(11) << t.max_ms << "\n";
+    }
+    std::cout << std::defaultfloat << std::flush;
+    return run.errors ? 1 : 0;
+}
+
 std::vector<std::string> split(const std::string s) {
     std::stringstream ss(s);
     std::istream_iterator<std::string> begin(ss);
@@ -2,12 +2,140 @@
 #include "linenoise.hpp"
 #include <vector>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <sstream>
 #include <sstream>
 #include <iterator>
 #include <cstdint>
+#include <thread>
 #include <boost/program_options.hpp>
 
 namespace bpo = boost::program_options;
+
+struct script_line {
+    size_t number;                      //line number in the script
+    std::vector<std::string> words;
+};
+
+struct command_time {
+    size_t count = 0;
+    double total_ms = 0;
+    double max_ms = 0;
+};
+
+struct script_run {
+    std::map<std::string, std::string> vars;
+    std::map<std::string, command_time> times;     //by command
+    size_t commands = 0;
+    size_t errors = 0;
+    bool quit = false;
+};
+
+/*
+ * Runs prompt commands one after the other on a worker thread, so that the
+ * prompt stays responsive and reports completions as they happen. clean,
+ * optimize and search_freq are handed to the library as background jobs,
+ * which leave the bus free between their status polls. stop does not queue.
+ */
+class command_executor {
+public:
+    explicit command_executor(elliptec &dev);
+    ~command_executor();
+
+    uint32_t submit(const std::vector<std::string> &words);
+    void print_jobs();
+    void cancel(uint32_t id);
+    // drops queued commands and maintenance of addr, then stops it without
+    // waiting for the command running on the worker
+    void stop(const std::string &addr);
+
+private:
+    enum job_state {
+        JOB_QUEUED = 0,
+        JOB_ACTIVE = 1,         //running on the worker
+        JOB_MAINTENANCE = 2     //running as background job of the library
+    };
+
+    struct job {
+        uint32_t id = 0;
+        std::vector<std::string> words;
+        std::string address;
+        job_state state = JOB_QUEUED;
+        uint32_t background_id = 0;                     //library job for JOB_MAINTENANCE
+        std::chrono::steady_clock::time_point started;
+    };
+
+    elliptec &_dev;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::deque<job> _jobs;          //queued, active and maintenance
+    uint32_t _next_id = 1;
+    bool _stop = false;
+    std::thread _worker;
+    std::vector<std::future<void>> _stoppers;   //stop runs off the prompt thread; finished ones are dropped at the next stop
+
+    void loop();
+    void check_maintenance();
+};
+
+/*
+ * Keeps positions, status and velocity of some devices on the top lines of
+ * the terminal while the prompt scrolls below them. Each turn asks one
+ * device, round robin, for position and status, and only while no typed
+ * command holds the bus. After a turn the bus is left alone for as long as
+ * the turn took, so typed commands get at least half of it. Velocity comes
+ * from the library's settings cache and costs no bus time.
+ */
+class device_watch {
+public:
+    // rate_hz caps the refresh of each device, 0 for as fast as the bus allows
+    device_watch(elliptec &dev, const std::vector<std::string> &addrs, double rate_hz);
+    ~device_watch();
+
+private:
+    static constexpr double BUS_SHARE = 0.5;    //of the bus time the watch may take
+    static constexpr uint16_t BUS_RETRY_MS = 20;    //next try while a command holds the bus
+
+    struct row {
+        std::string address;
+        std::string position = "-";
+        std::string status = "-";
+        std::string velocity = "-";
+    };
+
+    elliptec &_dev;
+    std::vector<row> _rows;
+    double _rate_hz;
+    bool _was_quiet;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    bool _stop = false;
+    std::thread _worker;
+
+    void loop();
+    void poll(row &r);
+    void draw(double hz);
+};
+
+std::optional<ell_maint_op> maintenance_op(const std::string &cmd);
+std::string join(const std::vector<std::string> &words);
 std::vector<std::string> split(const std::string s);
+bool run_command(elliptec &dev, const std::vector<std::string> &linevec);
+std::vector<script_line> read_script(std::istream &in);
+size_t block_end(const std::vector<script_line> &lines, size_t begin);
+std::vector<std::string> substitute(const std::vector<std::string> &words, const std::map<std::string, std::string> &vars);
+bool is_moveabsolute(const std::vector<std::string> &words);
+void run_block(elliptec &dev, const std::vector<script_line> &lines, size_t begin, size_t end, script_run &run);
+int run_script(elliptec &dev, std::istream &in);
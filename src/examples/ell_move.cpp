@@ -4,6 +4,10 @@ int main(int argc, char **argv) {
     std::string devname = "";
     uint mnum = 0;
     float angle = 0;
+    std::string sockpath = "";
+    ell_home_policy home_policy = HOME_ALWAYS;
+    std::string state_path = "";
+    ell_transport_config transport;
     
     /*
      * parse arguments
@@ -15,6 +19,10 @@ int main(int argc, char **argv) {
             ("device-path,d", bpo::value<std::string>(), "elliptec controller device path")
             ("motor-id,i", bpo::value<uint>()->default_value(0), "motor idto rotate")
             ("angle,a", bpo::value<float>()->default_value(0), "angle to rotate to")
+            ("socket,s", bpo::value<std::string>(), "use running ell_daemon at this socket instead of the device")
+            ("home-policy", bpo::value<std::string>()->default_value("always"), "homing on startup: always, if-needed, lazy or never")
+            ("state-file", bpo::value<std::string>()->default_value(""), "file persisting device positions between runs")
+            ("transport", bpo::value<std::string>()->default_value("boost"), "backend: boost, posix (low latency serial), tcp (device is host:port) or loopback (device lists emulated addr:type pairs)")
             ;
         
         bpo::options_description cmdline_options;
@@ -32,9 +40,12 @@ int main(int argc, char **argv) {
             return 0;
         }
 
+        if (vm.count("socket")) {
+            sockpath = vm["socket"].as< std::string >();
+        }
         if (vm.count("device-path")) {
             devname = vm["device-path"].as< std::string >();
-        } else {
+        } else if (sockpath == "") {
             std::cout << "no device specified.\n";
             return 1;
         }
@@ -51,6 +62,9 @@ int main(int argc, char **argv) {
             std::cout << "no angle specified.\n";
             return 1;
         }
+        home_policy = home_policy_from_string(vm["home-policy"].as< std::string >());
+        state_path = vm["state-file"].as< std::string >();
+        transport.kind = transport_kind_from_string(vm["transport"].as< std::string >());
         
     }
     catch(std::exception& e) {
@@ -63,10 +77,24 @@ int main(int argc, char **argv) {
     }
     std::vector<uint8_t> mnumvec(1,mnum);
     
+    /*
+     * rotate through daemon, no initialisation needed
+     */
+    if (sockpath != "") {
+        try {
+            ell_client client(sockpath);
+            client.move_absolute(std::to_string(mnum), angle);
+        } catch (std::exception& e) {
+            std::cerr << "error: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
     /*
      * rotate 
      */
-    elliptec dev = elliptec(devname, mnumvec, true, true);
+    elliptec dev = elliptec(devname, mnumvec, home_policy, true, state_path, transport);
     dev.move_absolute(std::to_string(mnum), angle);
         
     dev.close();
@@ -1,4 +1,5 @@
 #include "elliptec.h"
+#include "ell_client.h"
 #include <vector>
 #include <cstdint>
 #include <boost/program_options.hpp>
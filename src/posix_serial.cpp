@@ -0,0 +1,145 @@
+#include "posix_serial.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#include <system_error>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baud2speed(unsigned int baud_rate) {
+    switch (baud_rate) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+    }
+    throw std::invalid_argument("unsupported baud rate " + std::to_string(baud_rate));
+}
+
+static std::system_error errno_error(const std::string &what) {
+    return std::system_error(errno, std::generic_category(), "Posix_serial: " + what);
+}
+
+Posix_serial::Posix_serial(bool low_latency, int ftdi_latency_ms) : fd_transport(), _low_latency(low_latency), _ftdi_latency_ms(ftdi_latency_ms) {
+}
+
+Posix_serial::~Posix_serial() {
+    if (isOpen()) {
+        close();
+    }
+}
+
+void Posix_serial::open(const std::string &devname, unsigned int baud_rate) {
+    if (isOpen()) {
+        close();
+    }
+    speed_t speed = baud2speed(baud_rate);
+    int fd = ::open(devname.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw errno_error("cannot open " + devname);
+    }
+
+    // raw 8N1, no flow control. The fd is non-blocking and reads are driven
+    // by poll(), so VMIN=1/VTIME=0 only makes the driver report readiness
+    // on the first byte instead of batching characters.
+    termios tio{};
+    if (tcgetattr(fd, &tio) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "Posix_serial: tcgetattr on " + devname);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS | CSIZE);
+    tio.c_cflag |= CS8 | CLOCAL | CREAD;
+    tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "Posix_serial: tcsetattr on " + devname);
+    }
+    tcflush(fd, TCIOFLUSH);
+    adopt(fd);
+
+    if (_low_latency) {
+        set_low_latency();
+    }
+    if (_ftdi_latency_ms > 0) {
+        set_ftdi_latency(devname);
+    }
+}
+
+void Posix_serial::close() {
+    if (_fd < 0) {
+        return;
+    }
+    if ((_latency_orig > 0) && (_latency_orig != _latency_set)) {
+        std::ofstream(_latency_path) << _latency_orig;
+    }
+    _latency_path = "";
+    _latency_orig = -1;
+    _latency_set = -1;
+    fd_transport::close();
+}
+
+void Posix_serial::flush() {
+    if (_fd >= 0) {
+        tcflush(_fd, TCIFLUSH);
+    }
+    fd_transport::flush();
+}
+
+int Posix_serial::latencyTimer() const {
+    return _latency_set;
+}
+
+void Posix_serial::set_low_latency() {
+    serial_struct ss{};
+    if (ioctl(_fd, TIOCGSERIAL, &ss) != 0) {
+        return;
+    }
+    ss.flags |= ASYNC_LOW_LATENCY;
+    ioctl(_fd, TIOCSSERIAL, &ss);
+}
+
+// /dev/serial/by-id/... and other symlinks resolve to /dev/ttyUSBn, whose
+// usb-serial sysfs node has the latency_timer attribute on FTDI adapters.
+void Posix_serial::set_ftdi_latency(const std::string &devname) {
+    char *real = realpath(devname.c_str(), nullptr);
+    if (real == nullptr) {
+        return;
+    }
+    std::string tty(real);
+    std::free(real);
+    tty = tty.substr(tty.find_last_of('/') + 1);
+    std::string path = "/sys/bus/usb-serial/devices/" + tty + "/latency_timer";
+
+    int current = -1;
+    if (!(std::ifstream(path) >> current)) {
+        return;
+    }
+    _latency_path = path;
+    _latency_orig = current;
+    _latency_set = current;
+    if (current == _ftdi_latency_ms) {
+        return;
+    }
+    std::ofstream out(path);
+    out << _ftdi_latency_ms;
+    out.close();
+    if (out) {
+        _latency_set = _ftdi_latency_ms;
+    }
+}